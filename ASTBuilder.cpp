@@ -1,62 +1,52 @@
 #include "ASTBuilder.h"
-#include <cctype>
 
 // ---------------- CST helpers ----------------
-TreeNode *ASTBuilder::skipTo(TreeNode *n, const std::string &value)
+namespace
 {
-    for (; n && n->value != value; n = n->rightSibling)
-    {
-    }
-    return n;
-}
-TreeNode *ASTBuilder::after(TreeNode *n, const std::string &value)
+// Interior CST nodes stand for no single token, so they have no offset;
+// this tells them from identifiers spelled like their labels
+bool isStructural(TreeRef n) { return n->offset == NO_OFFSET; }
+
+// The k-th child of n, counting from 1
+TreeRef child(TreeRef n, int k)
 {
-    n = skipTo(n, value);
-    return n ? n->rightSibling : nullptr;
+    TreeRef c = n->leftChild;
+    while (--k > 0)
+        c = c->rightSibling;
+    return c;
 }
-std::string ASTBuilder::takeString(TreeNode *n)
-{
-    // StringLiteral -> '"' content '"'
-    std::string val = "";
-    if (n && n->leftChild && n->leftChild->rightSibling) {
-        val = n->leftChild->rightSibling->value;
-    }
-    //remove trailing qiuote if its there
-    if (!val.empty() && val.back() == '"') {
-        val.pop_back();
-    }
-
-    return val;
 }
-std::string ASTBuilder::takeChar(TreeNode *n)
+
+Symbol ASTBuilder::withoutTrailing(Symbol val, char quote)
 {
-    // CharLiteral -> '\'' content '\''
-    std::string val = "";
-    if (n && n->leftChild && n->leftChild->rightSibling) {
-        val = n->leftChild->rightSibling->value;
+    std::string_view text = Interner::spelling(val);
+    if (!text.empty() && text.back() == quote) {
+        val = Interner::intern(text.substr(0, text.size() - 1));
     }
-    //Remove trailing quote if there
-    if (!val.empty() && val.back() == '\'') {
-        val.pop_back();
-    }
-
     return val;
 }
-bool ASTBuilder::looksNumber(const std::string &s)
+bool ASTBuilder::isInteger(Symbol value)
 {
-    if (s.empty())
-        return false;
-    size_t i = (s[0] == '-' || s[0] == '+') ? 1 : 0;
-    if (i >= s.size())
-        return false;
-    for (; i < s.size(); ++i)
-        if (!std::isdigit((unsigned char)s[i]))
-            return false;
-    return true;
+    // the tokenizer pooled every integer literal it saw
+    const Literal *literal = LiteralPool::find(value);
+    return literal && literal->kind == Literal::INTEGER_LITERAL;
 }
 
 // ---------------- Public ----------------
-ASTNode *ASTBuilder::build(TreeNode *cstRoot) { return cstRoot ? buildProgram(cstRoot) : nullptr; }
+ASTNode *ASTBuilder::buildTopLevel(TreeRef unit)
+{
+    if (!unit)
+        return nullptr;
+    Pending pending;
+    ASTNode *top = buildNode(unit, pending);
+    while (!pending.empty())
+    {
+        auto [n, node] = pending.back();
+        pending.pop_back();
+        buildChildren(n, node, pending);
+    }
+    return top;
+}
 
 void ASTBuilder::printExpected(ASTNode *root, std::ostream &out)
 {
@@ -71,247 +61,181 @@ void ASTBuilder::printExpected(ASTNode *root, std::ostream &out)
 
 void ASTBuilder::free(ASTNode *root)
 {
-    if (!root)
-        return;
-    free(root->leftChild);
-    free(root->rightSibling);
-    delete root;
+    std::vector<ASTNode *> pending;
+    if (root)
+        pending.push_back(root);
+    while (!pending.empty())
+    {
+        ASTNode *n = pending.back();
+        pending.pop_back();
+        if (n->leftChild)
+            pending.push_back(n->leftChild);
+        if (n->rightSibling)
+            pending.push_back(n->rightSibling);
+        delete n;
+    }
 }
 
 // ---------------- Builders ----------------
-ASTNode *ASTBuilder::buildProgram(TreeNode *n)
+ASTNode *ASTBuilder::buildNode(TreeRef n, Pending &pending)
 {
-    ASTNode *prog = new ASTNode("Program", "", n->line);
-    for (TreeNode *c = n->leftChild; c; c = c->rightSibling)
-        if (ASTNode *t = buildTopLevel(c))
-            ASTAddChild(prog, t);
-    return prog;
-}
+    // Parentheses only group, and an expression statement is its call
+    while (isStructural(n) && (n->value == SYM_PAREN_EXPR || n->value == SYM_EXPR_STMT))
+        n = n->value == SYM_PAREN_EXPR ? child(n, 2) : n->leftChild;
 
-ASTNode *ASTBuilder::buildTopLevel(TreeNode *n)
-{
-    if (!n)
+    // A token here is an operand
+    if (!isStructural(n))
+    {
+        Symbol kind = SYM_AST_ID;
+        if (isInteger(n->value))
+            kind = SYM_AST_INT;
+        else if (n->value == SYM_TRUE || n->value == SYM_FALSE)
+            kind = SYM_AST_BOOL;
+        return new ASTNode(kind, n->value, n->offset);
+    }
+
+    Symbol v = n->value;
+    if (v == SYM_CHAR_LITERAL)
+        return new ASTNode(SYM_AST_CHAR, withoutTrailing(child(n, 2)->value, '\''));
+    if (v == SYM_STRING_LITERAL)
+        return new ASTNode(SYM_AST_STR, withoutTrailing(child(n, 2)->value, '"'));
+
+    ASTNode *node;
+    if (v == SYM_FUNCTION || v == SYM_PROCEDURE)
+        node = new ASTNode(SYM_AST_ROUTINE);
+    else if (v == SYM_GLOBAL_DECL || v == SYM_DECLARATION)
+        node = new ASTNode(SYM_AST_DECL);
+    else if (v == SYM_BLOCK)
+        node = new ASTNode(SYM_BLOCK);
+    else if (v == SYM_IF_STMT)
+        node = new ASTNode(SYM_AST_IF);
+    else if (v == SYM_WHILE_STMT)
+        node = new ASTNode(SYM_AST_WHILE);
+    else if (v == SYM_FOR_STMT)
+        node = new ASTNode(SYM_AST_FOR);
+    else if (v == SYM_RETURN_STMT)
+        node = new ASTNode(SYM_AST_RETURN);
+    else if (v == SYM_ASSIGNMENT)
+        node = new ASTNode(SYM_AST_ASSIGN);
+    else if (v == SYM_FUNCTION_CALL)
+    {
+        TreeRef name = n->leftChild;
+        node = new ASTNode(name->value == SYM_PRINTF ? SYM_AST_PRINTF : SYM_AST_CALL, name->value, name->offset);
+    }
+    else if (v == SYM_ARRAY_ACCESS)
+        node = new ASTNode(SYM_AST_ARR_AT, n->leftChild->value, n->leftChild->offset);
+    else if (v == SYM_BINARY_OP)
+        node = new ASTNode(SYM_AST_BIN, child(n, 2)->value);
+    else if (v == SYM_UNARY_OP)
+        node = new ASTNode(SYM_AST_UN, n->leftChild->value);
+    else
         return nullptr;
-    if (n->value == "function" || n->value == "procedure")
-        return buildRoutine(n);
-    if (n->value == "GlobalDecl")
-        return buildDecl(n);
-    return nullptr;
-}
 
-ASTNode *ASTBuilder::buildRoutine(TreeNode *n)
-{
-    ASTNode *r = new ASTNode("Routine", "", n->line);
-    if (TreeNode *blk = skipTo(n->leftChild, "Block"))
-        ASTAddChild(r, buildBlock(blk));
-    return r;
+    pending.push_back({n, node});
+    return node;
 }
 
-ASTNode *ASTBuilder::buildDecl(TreeNode *n)
+void ASTBuilder::buildChildren(TreeRef n, ASTNode *node, Pending &pending)
 {
-    ASTNode *d = new ASTNode("Decl", "", n->line);
-    TreeNode *type = n->leftChild;
-    for (TreeNode *c = type ? type->rightSibling : nullptr; c; c = c->rightSibling)
+    ASTNode **tail = &node->leftChild;
+    auto add = [&](ASTNode *c)
+    {
+        if (!c)
+            return;
+        *tail = c;
+        tail = &c->rightSibling;
+    };
+
+    Symbol kind = node->kind;
+    if (kind == SYM_AST_ROUTINE)
+    {
+        // function: kw type name ( Parameters ) Block; procedure has no type
+        TreeRef blk = n->leftChild;
+        while (blk->rightSibling)
+            blk = blk->rightSibling;
+        add(buildNode(blk, pending));
+    }
+    else if (kind == SYM_AST_DECL)
+    {
+        // type VarDecl , VarDecl ... ;
+        for (TreeRef c = n->leftChild->rightSibling; c; c = c->rightSibling)
+            if (isStructural(c))
+                add(new ASTNode(SYM_AST_VAR, c->leftChild->value, c->leftChild->offset));
+    }
+    else if (kind == SYM_BLOCK)
     {
-        if (c->value == "VarDecl")
+        // { declarations statements }
+        for (TreeRef c = n->leftChild; c; c = c->rightSibling)
+            if (isStructural(c))
+                add(buildNode(c, pending));
+    }
+    else if (kind == SYM_AST_IF)
+    {
+        // if ( cond ) then [else stmt]
+        TreeRef thenS = child(n, 5);
+        add(buildNode(child(n, 3), pending));
+        add(buildNode(thenS, pending));
+        if (TreeRef e = thenS->rightSibling)
         {
-            TreeNode *name = c->leftChild;
-            ASTAddChild(d, new ASTNode("Var", name ? name->value : "", name ? name->line : n->line));
+            add(new ASTNode(SYM_AST_ELSE, SYM_NONE, e->offset));
+            add(buildNode(e->rightSibling, pending));
         }
     }
-    return d;
-}
-
-ASTNode *ASTBuilder::buildStatement(TreeNode *n)
-{
-    if (!n)
-        return nullptr;
-    if (n->value == "IfStmt")
-        return buildIf(n);
-    if (n->value == "WhileStmt")
-        return buildWhile(n);
-    if (n->value == "ForStmt")
-        return buildFor(n);
-    if (n->value == "ReturnStmt")
-        return buildReturn(n);
-    if (n->value == "Assignment")
-        return buildAssignment(n);
-    if (n->value == "FunctionCall")
-        return buildCall(n);
-    if (n->value == "Block")
-        return buildBlock(n);
-    if (n->value == "Declaration")
-        return buildDecl(n);
-    if (n->value == "ExprStmt")
+    else if (kind == SYM_AST_WHILE)
     {
-        TreeNode *call = n->leftChild;
-        return (call && call->value == "FunctionCall") ? buildCall(call) : nullptr;
+        // while ( cond ) body
+        add(buildNode(child(n, 3), pending));
+        add(buildNode(child(n, 5), pending));
     }
-    return nullptr;
-}
-
-ASTNode *ASTBuilder::buildBlock(TreeNode *n)
-{
-    ASTNode *b = new ASTNode("Block", "", n->line);
-    for (TreeNode *c = n->leftChild; c; c = c->rightSibling)
-        if (ASTNode *s = buildStatement(c))
-            ASTAddChild(b, s);
-    return b;
-}
-
-ASTNode *ASTBuilder::buildIf(TreeNode *n)
-{
-    ASTNode *node = new ASTNode("If", "", n->line);
-    if (TreeNode *cond = after(n->leftChild, "("))
-        ASTAddChild(node, buildExpr(cond));
-    if (TreeNode *thenS = after(n->leftChild, ")"))
-        ASTAddChild(node, buildStatement(thenS));
-    if (TreeNode *e = skipTo(n->leftChild, "else"))
+    else if (kind == SYM_AST_FOR)
     {
-        ASTAddChild(node, new ASTNode("Else", "", e->line));
-        ASTAddChild(node, buildStatement(e->rightSibling));
+        // for ( init ; cond ; step ) body
+        for (int k = 3; k <= 9; k += 2)
+            add(buildNode(child(n, k), pending));
     }
-    return node;
-}
-
-ASTNode *ASTBuilder::buildWhile(TreeNode *n)
-{
-    ASTNode *node = new ASTNode("While", "", n->line);
-    if (TreeNode *cond = after(n->leftChild, "("))
-        ASTAddChild(node, buildExpr(cond));
-    if (TreeNode *body = after(n->leftChild, ")"))
-        ASTAddChild(node, buildStatement(body));
-    return node;
-}
-
-ASTNode *ASTBuilder::buildFor(TreeNode *n)
-{
-    ASTNode *node = new ASTNode("For", "", n->line);
-    TreeNode *cur = after(n->leftChild, "(");
-
-    if (cur && cur->value == "Assignment")
+    else if (kind == SYM_AST_RETURN)
     {
-        ASTAddChild(node, buildAssignment(cur));
-        cur = after(cur, ";");
+        // return expr ;
+        add(buildNode(child(n, 2), pending));
     }
-    if (cur)
+    else if (kind == SYM_AST_ASSIGN)
     {
-        ASTAddChild(node, buildExpr(cur));
-        cur = after(cur, ";");
+        // name [ '[' index ']' ] = expr [;]
+        TreeRef name = n->leftChild, eq = name->rightSibling;
+        if (eq->value == SYM_L_BRACKET)
+        {
+            ASTNode *target = new ASTNode(SYM_AST_ARR_AT, name->value, name->offset);
+            target->leftChild = buildNode(eq->rightSibling, pending);
+            add(target);
+            eq = eq->rightSibling->rightSibling->rightSibling;
+        }
+        else
+            add(new ASTNode(SYM_AST_ID, name->value, name->offset));
+        add(buildNode(eq->rightSibling, pending));
     }
-    if (cur && cur->value == "Assignment")
-        ASTAddChild(node, buildAssignment(cur));
-
-    if (TreeNode *body = after(n->leftChild, ")"))
-        ASTAddChild(node, buildStatement(body));
-    return node;
-}
-
-ASTNode *ASTBuilder::buildReturn(TreeNode *n)
-{
-    ASTNode *r = new ASTNode("Return", "", n->line);
-    if (TreeNode *expr = after(n->leftChild, "return"))
-        ASTAddChild(r, buildExpr(expr));
-    return r;
-}
-
-ASTNode *ASTBuilder::buildAssignment(TreeNode *n)
-{
-    ASTNode *as = new ASTNode("Assign", "", n->line);
-    TreeNode *lhs = n->leftChild;
-    ASTNode *L = nullptr;
-    if (lhs && lhs->rightSibling && lhs->rightSibling->value == "[")
+    else if (kind == SYM_AST_CALL || kind == SYM_AST_PRINTF)
     {
-        L = new ASTNode("ArrAt", lhs->value, lhs->line);
-        ASTAddChild(L, buildExpr(lhs->rightSibling->rightSibling));
+        // name ( arg , arg ... ) -- the last child is the ')'
+        for (TreeRef a = child(n, 3); a && a->rightSibling; a = a->rightSibling)
+            if (isStructural(a) || a->value != SYM_COMMA)
+                add(buildNode(a, pending));
     }
-    else if (lhs)
+    else if (kind == SYM_AST_ARR_AT)
     {
-        L = new ASTNode("Id", lhs->value, lhs->line);
+        // name [ index ]
+        add(buildNode(child(n, 3), pending));
     }
-    if (L)
-        ASTAddChild(as, L);
-    if (TreeNode *rhs = after(n->leftChild, "="))
-        ASTAddChild(as, buildExpr(rhs));
-    return as;
-}
-
-ASTNode *ASTBuilder::buildCall(TreeNode *n)
-{
-    TreeNode *name = n->leftChild;
-    std::string who = name ? name->value : "";
-    ASTNode *call = new ASTNode(who == "printf" ? "Printf" : "Call", who, name ? name->line : n->line);
-    TreeNode *a = after(name ? name->rightSibling : nullptr, "(");
-    for (; a && a->value != ")"; a = a->rightSibling)
+    else if (kind == SYM_AST_BIN)
     {
-        if (a->value == ",")
-            continue;
-        ASTAddChild(call, buildExpr(a));
-        while (a->rightSibling && a->rightSibling->value != "," && a->rightSibling->value != ")")
-            a = a->rightSibling;
+        // left op right
+        add(buildNode(n->leftChild, pending));
+        add(buildNode(child(n, 3), pending));
     }
-    return call;
-}
-
-// ---------------- Expressions ----------------
-ASTNode *ASTBuilder::buildExpr(TreeNode *n)
-{
-    if (!n)
-        return nullptr;
-    if (n->value == "BinaryOp")
-        return buildBinary(n);
-    if (n->value == "UnaryOp")
-        return buildUnary(n);
-    if (n->value == "ParenExpr")
+    else if (kind == SYM_AST_UN)
     {
-        TreeNode *i = n->leftChild ? n->leftChild->rightSibling : nullptr;
-        return buildExpr(i);
+        // op operand
+        add(buildNode(child(n, 2), pending));
     }
-    if (n->value == "FunctionCall")
-        return buildCall(n);
-    if (n->value == "ArrayAccess")
-        return buildArrayAccess(n);
-    return buildPrimary(n);
-}
-ASTNode *ASTBuilder::buildPrimary(TreeNode *n)
-{
-    if (!n)
-        return nullptr;
-    if (looksNumber(n->value))
-        return new ASTNode("Int", n->value, n->line);
-    if (n->value == "TRUE" || n->value == "FALSE")
-        return new ASTNode("Bool", n->value, n->line);
-    if (n->value == "StringLiteral")
-        return new ASTNode("Str", takeString(n), n->line);
-    if (n->value == "CharLiteral")
-        return new ASTNode("Char", takeChar(n), n->line);
-    // identifier: anything that isn't punctuation/keywords we see around primaries
-    if (n->value != "(" && n->value != ")" && n->value != "[" && n->value != "]" && n->value != "{" && n->value != "}" &&
-        n->value != "Parameters" && n->value != "Parameter" && n->value != "," && n->value != ";" && n->value != "=")
-        return new ASTNode("Id", n->value, n->line);
-    return new ASTNode("Id", "", n->line);
-}
-ASTNode *ASTBuilder::buildUnary(TreeNode *n)
-{
-    TreeNode *op = n->leftChild;
-    ASTNode *u = new ASTNode("Un", op ? op->value : "", n->line);
-    ASTAddChild(u, buildExpr(op ? op->rightSibling : nullptr));
-    return u;
-}
-ASTNode *ASTBuilder::buildBinary(TreeNode *n)
-{
-    TreeNode *L = n->leftChild, *op = L ? L->rightSibling : nullptr;
-    ASTNode *b = new ASTNode("Bin", op ? op->value : "", n->line);
-    ASTAddChild(b, buildExpr(L));
-    ASTAddChild(b, buildExpr(op ? op->rightSibling : nullptr));
-    return b;
-}
-ASTNode *ASTBuilder::buildArrayAccess(TreeNode *n)
-{
-    TreeNode *name = n->leftChild, *idx = name && name->rightSibling ? name->rightSibling->rightSibling : nullptr;
-    ASTNode *arr = new ASTNode("ArrAt", name ? name->value : "", name ? name->line : n->line);
-    ASTAddChild(arr, buildExpr(idx));
-    return arr;
 }
 
 // ---------------- Printing ----------------
@@ -319,159 +243,166 @@ void ASTBuilder::printAssignLHS(ASTNode *lhs, std::ostream &out)
 {
     if (!lhs)
         return;
-    if (lhs->kind == "ArrAt")
+    if (lhs->kind == SYM_AST_ARR_AT)
     {
-        out << lhs->text << "   [   ";
+        out << Interner::spelling(lhs->text) << "   [   ";
         ASTBuilder::printRPN(lhs->leftChild, out);
         out << "   ]   ";
     }
     else
     {
-        out << lhs->text << "   ";
+        out << Interner::spelling(lhs->text) << "   ";
     }
 }
 
-void ASTBuilder::printBlock(ASTNode *n, std::ostream &out)
-{
-    out << "BEGIN BLOCK\n";
-    for (ASTNode *c = n->leftChild; c; c = c->rightSibling)
-        printStmt(c, out);
-    out << "END BLOCK\n";
-}
-
 void ASTBuilder::printStmt(ASTNode *n, std::ostream &out, bool top)
 {
-    if (!n)
-        return;
-
-    if (n->kind == "Decl")
+    // Nested statements wait on pending rather than the native stack
+    std::vector<Piece> pending{{n, nullptr, false}};
+    while (!pending.empty())
     {
-        int cnt = 0;
-        for (ASTNode *v = n->leftChild; v; v = v->rightSibling)
-            if (v->kind == "Var")
-            {
-                ++cnt;
-                out << "DECLARATION\n";
-            }
-        if (cnt == 0)
-            out << "DECLARATION\n";
-        return;
-    }
-    if (n->kind == "Block")
-    {
-        printBlock(n, out);
-        return;
-    }
-
-    if (n->kind == "Routine")
-    {
-        if (top)
-            out << "DECLARATION\n";
-        for (ASTNode *c = n->leftChild; c; c = c->rightSibling)
-            if (c->kind == "Block")
-                printBlock(c, out);
-        return;
-    }
-
-    if (n->kind == "Assign")
-    {
-        out << "ASSIGNMENT   ";
-        ASTNode *lhs = n->leftChild, *rhs = lhs ? lhs->rightSibling : nullptr;
-        printAssignLHS(lhs, out);
-        if (rhs)
+        Piece p = pending.back();
+        pending.pop_back();
+        if (p.text)
         {
-            printRPN(rhs, out);
-            out << "   =\n";
+            out << p.text;
+            continue;
         }
-        else
-            out << "=\n";
-        return;
-    }
+        ASTNode *s = p.node;
+        if (!s)
+            continue;
+        if (p.siblings && s->rightSibling)
+            pending.push_back({s->rightSibling, nullptr, true});
 
-    if (n->kind == "If")
-    {
-        out << "IF   ";
-        ASTNode *cond = n->leftChild, *thenS = cond ? cond->rightSibling : nullptr, *maybe = thenS ? thenS->rightSibling : nullptr;
-        printRPN(cond, out);
-        out << "\n";
-        printStmt(thenS, out);
-        if (maybe && maybe->kind == "Else")
+        if (s->kind == SYM_AST_DECL)
         {
-            out << "ELSE\n";
-            printStmt(maybe->rightSibling, out);
+            int cnt = 0;
+            for (ASTNode *v = s->leftChild; v; v = v->rightSibling)
+                if (v->kind == SYM_AST_VAR)
+                {
+                    ++cnt;
+                    out << "DECLARATION\n";
+                }
+            if (cnt == 0)
+                out << "DECLARATION\n";
+            continue;
+        }
+        if (s->kind == SYM_BLOCK)
+        {
+            out << "BEGIN BLOCK\n";
+            pending.push_back({nullptr, "END BLOCK\n", false});
+            pending.push_back({s->leftChild, nullptr, true});
+            continue;
         }
-        return;
-    }
 
-    if (n->kind == "While")
-    {
-        out << "WHILE   ";
-        ASTNode *cond = n->leftChild, *body = cond ? cond->rightSibling : nullptr;
-        printRPN(cond, out);
-        out << "\n";
-        printStmt(body, out);
-        return;
-    }
+        if (s->kind == SYM_AST_ROUTINE)
+        {
+            if (top && s == n)
+                out << "DECLARATION\n";
+            // its only child is the body
+            pending.push_back({s->leftChild, nullptr, true});
+            continue;
+        }
 
-    if (n->kind == "For")
-    {
-        ASTNode *init = n->leftChild, *cond = init ? init->rightSibling : nullptr, *step = cond ? cond->rightSibling : nullptr, *body = step ? step->rightSibling : nullptr;
-        out << "FOR EXPRESSION 1   ";
+        if (s->kind == SYM_AST_ASSIGN)
         {
-            ASTNode *L = init ? init->leftChild : nullptr, *R = L ? L->rightSibling : nullptr;
-            printAssignLHS(L, out);
-            if (R)
+            out << "ASSIGNMENT   ";
+            ASTNode *lhs = s->leftChild, *rhs = lhs ? lhs->rightSibling : nullptr;
+            printAssignLHS(lhs, out);
+            if (rhs)
             {
-                printRPN(R, out);
+                printRPN(rhs, out);
                 out << "   =\n";
             }
             else
                 out << "=\n";
+            continue;
         }
-        out << "FOR EXPRESSION 2   ";
-        printRPN(cond, out);
-        out << "\n";
-        out << "FOR EXPRESSION 3   ";
+
+        if (s->kind == SYM_AST_IF)
         {
-            ASTNode *L = step ? step->leftChild : nullptr, *R = L ? L->rightSibling : nullptr;
-            printAssignLHS(L, out);
-            if (R)
+            out << "IF   ";
+            ASTNode *cond = s->leftChild, *thenS = cond ? cond->rightSibling : nullptr, *maybe = thenS ? thenS->rightSibling : nullptr;
+            printRPN(cond, out);
+            out << "\n";
+            if (maybe && maybe->kind == SYM_AST_ELSE)
             {
-                printRPN(R, out);
-                out << "   =\n";
+                pending.push_back({maybe->rightSibling, nullptr, false});
+                pending.push_back({nullptr, "ELSE\n", false});
             }
-            else
-                out << "=\n";
+            pending.push_back({thenS, nullptr, false});
+            continue;
         }
-        printStmt(body, out);
-        return;
-    }
 
-    if (n->kind == "Return")
-    {
-        out << "RETURN   ";
-        printRPN(n->leftChild, out);
-        out << "\n";
-        return;
-    }
-    if (n->kind == "Call")
-    {
-        printCall(n, out);
-        return;
-    }
-    if (n->kind == "Printf")
-    {
-        printPrintf(n, out);
-        return;
-    }
+        if (s->kind == SYM_AST_WHILE)
+        {
+            out << "WHILE   ";
+            ASTNode *cond = s->leftChild, *body = cond ? cond->rightSibling : nullptr;
+            printRPN(cond, out);
+            out << "\n";
+            pending.push_back({body, nullptr, false});
+            continue;
+        }
 
-    for (ASTNode *c = n->leftChild; c; c = c->rightSibling)
-        printStmt(c, out);
+        if (s->kind == SYM_AST_FOR)
+        {
+            ASTNode *init = s->leftChild, *cond = init ? init->rightSibling : nullptr, *step = cond ? cond->rightSibling : nullptr, *body = step ? step->rightSibling : nullptr;
+            out << "FOR EXPRESSION 1   ";
+            {
+                ASTNode *L = init ? init->leftChild : nullptr, *R = L ? L->rightSibling : nullptr;
+                printAssignLHS(L, out);
+                if (R)
+                {
+                    printRPN(R, out);
+                    out << "   =\n";
+                }
+                else
+                    out << "=\n";
+            }
+            out << "FOR EXPRESSION 2   ";
+            printRPN(cond, out);
+            out << "\n";
+            out << "FOR EXPRESSION 3   ";
+            {
+                ASTNode *L = step ? step->leftChild : nullptr, *R = L ? L->rightSibling : nullptr;
+                printAssignLHS(L, out);
+                if (R)
+                {
+                    printRPN(R, out);
+                    out << "   =\n";
+                }
+                else
+                    out << "=\n";
+            }
+            pending.push_back({body, nullptr, false});
+            continue;
+        }
+
+        if (s->kind == SYM_AST_RETURN)
+        {
+            out << "RETURN   ";
+            printRPN(s->leftChild, out);
+            out << "\n";
+            continue;
+        }
+        if (s->kind == SYM_AST_CALL)
+        {
+            printCall(s, out);
+            continue;
+        }
+        if (s->kind == SYM_AST_PRINTF)
+        {
+            printPrintf(s, out);
+            continue;
+        }
+
+        pending.push_back({s->leftChild, nullptr, true});
+    }
 }
 
 void ASTBuilder::printCall(ASTNode *n, std::ostream &out)
 {
-    out << "CALL   " << n->text << "   (   ";
+    out << "CALL   " << Interner::spelling(n->text) << "   (   ";
     bool first = true;
     for (ASTNode *a = n->leftChild; a; a = a->rightSibling)
     {
@@ -500,68 +431,83 @@ void ASTBuilder::printPrintf(ASTNode *n, std::ostream &out)
 
 void ASTBuilder::printRPN(ASTNode *n, std::ostream &out, StrMode mode)
 {
-    if (!n)
-        return;
-    if (n->kind == "Bin")
-    {
-        ASTNode *L = n->leftChild, *R = L ? L->rightSibling : nullptr;
-        printRPN(L, out, mode);
-        out << "   ";
-        printRPN(R, out, mode);
-        out << "   " << n->text;
-        return;
-    }
-    if (n->kind == "Un")
-    {
-        printRPN(n->leftChild, out, mode);
-        out << "   " << n->text;
-        return;
-    }
-    if (n->kind == "Id" || n->kind == "Int" || n->kind == "Bool")
+    // Operands before their operator; nesting waits on pending rather than
+    // the native stack
+    std::vector<Piece> pending{{n, nullptr, false}};
+    while (!pending.empty())
     {
-        out << n->text;
-        return;
-    }
-    if (n->kind == "ArrAt")
-    {
-        out << n->text << "   [   ";
-        printRPN(n->leftChild, out, mode);
-        out << "   ]";
-        return;
-    }
-    if (n->kind == "Str")
-    {
-        if (mode == StrMode::Bare) {
-            std::string text = n->text;
-            //remove trailin spacee
-            while (!text.empty() && text.back() == ' ') {
-                text.pop_back();
+        Piece p = pending.back();
+        pending.pop_back();
+        if (p.text)
+        {
+            out << p.text;
+            if (p.node)
+                out << Interner::spelling(p.node->text);
+            continue;
+        }
+        ASTNode *e = p.node;
+        if (!e)
+            continue;
+        if (p.siblings && e->rightSibling)
+        {
+            pending.push_back({e->rightSibling, nullptr, true});
+            pending.push_back({nullptr, "   ,   ", false});
+        }
+
+        if (e->kind == SYM_AST_BIN)
+        {
+            ASTNode *L = e->leftChild, *R = L ? L->rightSibling : nullptr;
+            pending.push_back({e, "   ", false});
+            pending.push_back({R, nullptr, false});
+            pending.push_back({nullptr, "   ", false});
+            pending.push_back({L, nullptr, false});
+            continue;
+        }
+        if (e->kind == SYM_AST_UN)
+        {
+            pending.push_back({e, "   ", false});
+            pending.push_back({e->leftChild, nullptr, false});
+            continue;
+        }
+        if (e->kind == SYM_AST_ID || e->kind == SYM_AST_INT || e->kind == SYM_AST_BOOL)
+        {
+            out << Interner::spelling(e->text);
+            continue;
+        }
+        if (e->kind == SYM_AST_ARR_AT)
+        {
+            out << Interner::spelling(e->text) << "   [   ";
+            pending.push_back({nullptr, "   ]", false});
+            pending.push_back({e->leftChild, nullptr, false});
+            continue;
+        }
+        if (e->kind == SYM_AST_STR)
+        {
+            if (mode == StrMode::Bare) {
+                std::string_view text = Interner::spelling(e->text);
+                //remove trailin spacee
+                while (!text.empty() && text.back() == ' ') {
+                    text.remove_suffix(1);
+                }
+                out << text;
             }
-            out << text;
+            else {
+                out << "\"   " << Interner::spelling(e->text) << "   \"";
+            }
+            continue;
         }
-        else {
-            out << "\"   " << n->text << "   \"";
+        if (e->kind == SYM_AST_CHAR)
+        {
+            out << "'   " << Interner::spelling(e->text) << "   '";
+            continue;
         }
-        return;
-    }
-    if (n->kind == "Char")
-    {
-        out << "'   " << n->text << "   '";
-        return;
-    }
-    if (n->kind == "Call")
-    {
-        out << n->text << "   (   ";
-        bool first = true;
-        for (ASTNode *a = n->leftChild; a; a = a->rightSibling)
+        if (e->kind == SYM_AST_CALL)
         {
-            if (!first)
-                out << "   ,   ";
-            printRPN(a, out, mode);
-            first = false;
+            out << Interner::spelling(e->text) << "   (   ";
+            pending.push_back({nullptr, "   )", false});
+            pending.push_back({e->leftChild, nullptr, true});
+            continue;
         }
-        out << "   )";
-        return;
+        out << Interner::spelling(e->text);
     }
-    out << n->text;
 }
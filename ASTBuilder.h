@@ -2,18 +2,21 @@
 #define ASTBUILDER_H
 
 #include <string>
+#include <string_view>
 #include <ostream>
+#include <utility>
+#include <vector>
 #include "CSTParser.h"
 
 // Tiny LCRS AST limited to what the tests exercise.
 struct ASTNode
 {
-    std::string kind; // Program, Routine, Block, Decl, Var, Assign, If, While, For, Return, Call, Printf, Bin, Un, Id, Int, Str, Char, Bool, ArrAt, Else
-    std::string text; // identifier / literal / operator / callee
-    int line;
+    Symbol kind; // Program, Routine, Block, Decl, Var, Assign, If, While, For, Return, Call, Printf, Bin, Un, Id, Int, Str, Char, Bool, ArrAt, Else
+    Symbol text; // identifier / literal / operator / callee
+    uint32_t offset; // where it starts in the source, or NO_OFFSET
     ASTNode *leftChild{}, *rightSibling{};
-    ASTNode(std::string k = "", std::string t = "", int ln = 0)
-        : kind(std::move(k)), text(std::move(t)), line(ln) {}
+    ASTNode(Symbol k = SYM_NONE, Symbol t = SYM_NONE, uint32_t off = NO_OFFSET)
+        : kind(k), text(t), offset(off) {}
 };
 
 inline void ASTAddChild(ASTNode *p, ASTNode *c)
@@ -31,36 +34,24 @@ inline void ASTAddChild(ASTNode *p, ASTNode *c)
     s->rightSibling = c;
 }
 
+// Lowers a CST to the AST. Nodes are told apart by their place in the
+// tree and by whether they stand for a token (see CSTNode::offset), never
+// by spelling alone, so a variable named "Block" is still a variable. Each
+// lowered node waits on a work list for its children, so the depth input
+// may nest to costs heap, not native stack.
 class ASTBuilder
 {
 public:
-    static ASTNode *build(TreeNode *cstRoot);
+    static ASTNode *buildTopLevel(TreeRef unit); // function/procedure/global decl, as CSTParser::parseUnit() gives it
     static void printExpected(ASTNode *root, std::ostream &out);
     static void free(ASTNode *root);
 
 private:
-    // Builders
-    static ASTNode *buildProgram(TreeNode *n);
-    static ASTNode *buildTopLevel(TreeNode *n); // function/procedure/global decl
-    static ASTNode *buildRoutine(TreeNode *n);  // function or procedure
-    static ASTNode *buildDecl(TreeNode *n);     // GlobalDecl or Declaration
-    static ASTNode *buildBlock(TreeNode *n);
-    static ASTNode *buildIf(TreeNode *n);
-    static ASTNode *buildWhile(TreeNode *n);
-    static ASTNode *buildFor(TreeNode *n);
-    static ASTNode *buildReturn(TreeNode *n);
-    static ASTNode *buildAssignment(TreeNode *n);
-    static ASTNode *buildCall(TreeNode *n);
+    // Lowered nodes whose children are still to be lowered, with the CST node each came from
+    typedef std::vector<std::pair<TreeRef, ASTNode *>> Pending;
 
-    // Statements & Expressions
-    static ASTNode *buildStatement(TreeNode *n);
-
-    // Expressions
-    static ASTNode *buildExpr(TreeNode *n);
-    static ASTNode *buildPrimary(TreeNode *n);
-    static ASTNode *buildUnary(TreeNode *n);
-    static ASTNode *buildBinary(TreeNode *n);
-    static ASTNode *buildArrayAccess(TreeNode *n);
+    static ASTNode *buildNode(TreeRef n, Pending &pending); // the node alone; queues it for its children
+    static void buildChildren(TreeRef n, ASTNode *node, Pending &pending);
 
     // Printing
     enum class StrMode
@@ -68,7 +59,14 @@ private:
         Quoted,
         Bare
     };
-    static void printBlock(ASTNode *n, std::ostream &out);
+    // What the printers still have to write, next last: a node, text, or text
+    // followed by a node's operator; siblings goes on along the node's list after it
+    struct Piece
+    {
+        ASTNode *node;
+        const char *text;
+        bool siblings;
+    };
     static void printStmt(ASTNode *n, std::ostream &out, bool top = false);
     static void printRPN(ASTNode *n, std::ostream &out, StrMode mode = StrMode::Quoted);
     static void printCall(ASTNode *n, std::ostream &out);
@@ -76,11 +74,8 @@ private:
     static void printAssignLHS(ASTNode *lhs, std::ostream &out); // moved inside class
 
     // Tiny CST helpers
-    static TreeNode *skipTo(TreeNode *n, const std::string &value);
-    static TreeNode *after(TreeNode *n, const std::string &value); // first node after token in same list
-    static std::string takeString(TreeNode *stringLitCST);
-    static std::string takeChar(TreeNode *charLitCST);
-    static bool looksNumber(const std::string &s);
+    static Symbol withoutTrailing(Symbol text, char quote); // literal content minus a closing quote
+    static bool isInteger(Symbol value);
 };
 
 #endif
@@ -1,170 +1,250 @@
 #include "CSTParser.h"
+#include "SourceBuffer.h"
+#include <algorithm>
 #include <iostream>
-#include <set>
+#include <thread>
 
 using namespace std;
 
-TreeNode::TreeNode(string val, int ln) : value(val), line(ln), leftChild(nullptr), rightSibling(nullptr) {}
-
-CSTParser::CSTParser(vector<Token> toks) : tokens(toks), current(0) {}
+ParseResult::ParseResult() : root(nullptr), dead(0) {}
 
+void ParseResult::release() {
+    nodes.clear();
+    units.clear();
+    dead = 0;
+    root = nullptr;
+}
 
-Token CSTParser::peek() {
-    while (current < tokens.size() &&
-           (tokens[current].type == WHITESPACE || tokens[current].type == NEWLINE)) {
-        current++;
+void ParseResult::compact() {
+    vector<CSTNode> packed;
+    packed.reserve(size());
+    packed.push_back(nodes[0]);
+    for (Unit& unit : units) {
+        NodeId base = static_cast<NodeId>(packed.size());
+        for (NodeId k = unit.root; k < unit.end; k++) {
+            CSTNode node = nodes[k];
+            if (node.firstChild != NO_NODE) {
+                node.firstChild = node.firstChild - unit.root + base;
+            }
+            if (node.nextSibling != NO_NODE) {
+                node.nextSibling = node.nextSibling - unit.root + base;
+            }
+            packed.push_back(node);
+        }
+        unit = {base, static_cast<NodeId>(packed.size())};
     }
-    if (current < tokens.size()) {
-        return tokens[current];
+
+    packed[0].firstChild = units.empty() ? NO_NODE : units[0].root;
+    for (size_t k = 0; k < units.size(); k++) {
+        packed[units[k].root].nextSibling = k + 1 < units.size() ? units[k + 1].root : NO_NODE;
     }
-    else {
-        return Token{END_OF_FILE, "", 0, 0};
+    nodes.swap(packed);
+    dead = 0;
+    root = TreeRef(nodes.data(), 0);
+}
+
+CSTParser::CSTParser(string_view src)
+    : tokens(src), source(src), lines(src), streamed(nullptr), deferErrors(false), nodes(nullptr), unitStart(0) {}
+
+// The bytes read so far never move, so source.data() stays valid for text()
+// as the source grows
+CSTParser::CSTParser(SourceBuffer& src)
+    : tokens(src), source(src.view()), lines(src.view()), streamed(&src), deferErrors(false), nodes(nullptr),
+      unitStart(0) {}
+
+CSTParser::CSTParser(const vector<Token>& toks, string_view src)
+    : tokens(toks), source(src), lines(src), streamed(nullptr), deferErrors(false), nodes(nullptr), unitStart(0) {}
+
+CSTParser::CSTParser(const TokenStore& toks, string_view src)
+    : tokens(toks), source(src), lines(src), streamed(nullptr), deferErrors(false), nodes(nullptr), unitStart(0) {}
+
+CSTParser::CSTParser(const TokenStore& toks, string_view src, size_t from)
+    : tokens(toks, from), source(src), lines(src), streamed(nullptr), deferErrors(false), nodes(nullptr),
+      unitStart(0) {}
+
+CSTParser::CSTParser(const IncrementalTokenizer& toks, string_view src, size_t from)
+    : tokens(toks, from), source(src), lines(src), streamed(nullptr), deferErrors(false), nodes(nullptr),
+      unitStart(0) {}
+
+void CSTParser::SyntaxError::report() const {
+    cerr << "Syntax error on line " << line << ": " << message << endl;
+    exit(1);
+}
+
+string_view CSTParser::text(const Token& tok) const {
+    return tok.text(source);
+}
+
+int CSTParser::lineOf(const Token& tok) const {
+    if (streamed) {
+        // Built over what has arrived by now, which includes tok
+        return LineTable(streamed->view()).line(tok.offset);
     }
+    return lines.line(tok.offset);
+}
+
+const Literal& CSTParser::literalOf(const Token& tok) const {
+    return *LiteralPool::find(tok.symbol);
 }
 
-Token CSTParser::advance() {
-    Token tok = peek();
-    if (current < tokens.size()) {
-        current++;
+Symbol CSTParser::symbolOf(const Token& tok) const {
+    if (tok.symbol != SYM_NONE) {
+        return tok.symbol;
     }
-    return tok;
+    return Interner::intern(text(tok));
 }
 
-bool CSTParser::check(TokenType type) {
-    return peek().type == type;
+void CSTParser::syntaxError(const Token& at, const string& message) const {
+    SyntaxError error{lineOf(at), message};
+    if (deferErrors) {
+        throw error;
+    }
+    error.report();
 }
 
-bool CSTParser::match(const string& value) {
-    return peek().value == value;
+bool CSTParser::checkName() {
+    TokenType type = peek().type;
+    return type == IDENTIFIER || isKeyword(type);
 }
 
-Token CSTParser::expect(TokenType type, const string& errorMsg) {
-    Token tok = peek();
-    if (tok.type != type) {
-        cerr << "Syntax error on line " << tok.line << ": " << errorMsg << endl;
-        exit(1);
+const Token& CSTParser::expectName(const char* errorMsg) {
+    if (!checkName()) {
+        syntaxError(peek(), errorMsg);
     }
     return advance();
 }
 
-Token CSTParser::expectValue(const string& value, const string& errorMsg) {
-    Token tok = peek();
-    if (tok.value != value) {
-        cerr << "Syntax error on line " << tok.line << ": " << errorMsg << endl;
-        exit(1);
+const Token& CSTParser::expect(TokenType type, const char* errorMsg) {
+    const Token& tok = peek();
+    if (tok.type != type) {
+        syntaxError(tok, errorMsg);
     }
     return advance();
 }
 
-void CSTParser::addChild(TreeNode* parent, TreeNode* child) {
-    if (!parent || !child) {
+NodeId CSTParser::makeNode(Symbol value, uint32_t off) {
+    nodes->push_back({value, off == NO_OFFSET ? NO_OFFSET : off - unitStart, NO_NODE, NO_NODE});
+    lastChild.push_back(NO_NODE);
+    return static_cast<NodeId>(nodes->size() - 1);
+}
+
+NodeId CSTParser::leaf(const Token& tok) {
+    return makeNode(symbolOf(tok), tok.offset);
+}
+
+void CSTParser::addChild(NodeId parent, NodeId child) {
+    if (parent == NO_NODE || child == NO_NODE) {
         return;
     }
 
-    if (!parent->leftChild) {
-        parent->leftChild = child;
+    vector<CSTNode>& tree = *nodes;
+    if (tree[parent].firstChild == NO_NODE) {
+        tree[parent].firstChild = child;
     }
     else {
-        TreeNode* sibling = parent->leftChild;
-        while (sibling->rightSibling != nullptr) {
-            sibling = sibling->rightSibling;
-        }
-        sibling->rightSibling = child;
+        tree[lastChild[parent]].nextSibling = child;
     }
+    lastChild[parent] = child;
 }
 
-TreeNode* CSTParser::parseProgram() {
-    TreeNode* root = new TreeNode("Program");
+NodeId CSTParser::parseProgram(vector<ParseResult::Unit>& units) {
+    NodeId root = makeNode(SYM_PROGRAM);
 
     while (!check(END_OF_FILE)) {
-        Token nextToken = peek();
-
-        if (match("function") || match("procedure")) {
-            TreeNode* funcNode = parseFunctionOrProcedure();
-            addChild(root, funcNode);
-        }
-        else if (match("int") || match("char") || match("bool") || match("void")) {
-            TreeNode* globalVar = parseGlobalDeclaration();
-            addChild(root, globalVar);
-        } else {
-            cerr << "Syntax error on line " << nextToken.line << ": unexpected token '" << nextToken.value << "'" << endl;
-            exit(1);
-        }
+        NodeId unit = parseTopLevel();
+        addChild(root, unit);
+        units.push_back({unit, static_cast<NodeId>(nodes->size())});
     }
 
     return root;
 }
 
-TreeNode* CSTParser::parseGlobalDeclaration() {
-    TreeNode* node = new TreeNode("GlobalDecl");
+NodeId CSTParser::parseTopLevel() {
+    unitStart = peek().offset;
+    NodeId unit;
+    if (check(KEYWORD_FUNCTION) || check(KEYWORD_PROCEDURE)) {
+        unit = parseFunctionOrProcedure();
+    }
+    else if (check(KEYWORD_INT) || check(KEYWORD_CHAR) || check(KEYWORD_BOOL) || check(KEYWORD_VOID)) {
+        unit = parseGlobalDeclaration();
+    }
+    else {
+        const Token& nextToken = peek();
+        syntaxError(nextToken, "unexpected token '" + string(text(nextToken)) + "'");
+    }
+    (*nodes)[unit].offset = unitStart;
+    return unit;
+}
+
+NodeId CSTParser::parseGlobalDeclaration() {
+    NodeId node = makeNode(SYM_GLOBAL_DECL);
 
     Token typeTok = advance();
-    addChild(node, new TreeNode(typeTok.value, typeTok.line));
+    addChild(node, leaf(typeTok));
 
     do {
         if (check(COMMA)) {
             Token comma = advance();
-            addChild(node, new TreeNode(comma.value, comma.line));
+            addChild(node, leaf(comma));
         }
 
-        TreeNode* varNode = parseVariableDeclarator();
+        NodeId varNode = parseVariableDeclarator();
         addChild(node, varNode);
 
     } while (check(COMMA));
 
     Token semi = expect(SEMICOLON, "expected ';'");
-    addChild(node, new TreeNode(semi.value, semi.line));
+    addChild(node, leaf(semi));
 
     return node;
 }
 
-TreeNode* CSTParser::parseFunctionOrProcedure() {
+NodeId CSTParser::parseFunctionOrProcedure() {
     Token keyword = advance();
-    TreeNode* node = new TreeNode(keyword.value);
-    addChild(node, new TreeNode(keyword.value, keyword.line));
+    NodeId node = makeNode(symbolOf(keyword));
+    addChild(node, leaf(keyword));
 
-    if (keyword.value == "function") {
+    if (keyword.type == KEYWORD_FUNCTION) {
         Token typeTok = advance();
-        addChild(node, new TreeNode(typeTok.value, typeTok.line));
+        addChild(node, leaf(typeTok));
     }
 
-    Token name = expect(IDENTIFIER, "expected identifier");
+    Token name = expectName("expected identifier");
 
-    if (isReservedWord(name.value)) {
-        cerr << "Syntax error on line " << name.line << ": reserved word \"" << name.value
-             << "\" cannot be used for the name of a function." << endl;
-        exit(1);
+    if (isKeyword(name.type)) {
+        syntaxError(name, "reserved word \"" + string(text(name)) +
+                          "\" cannot be used for the name of a function.");
     }
 
-    addChild(node, new TreeNode(name.value, name.line));
+    addChild(node, leaf(name));
 
     Token lparen = expect(L_PAREN, "expected '('");
-    addChild(node, new TreeNode(lparen.value, lparen.line));
+    addChild(node, leaf(lparen));
 
     addChild(node, parseParameters());
 
     Token rparen = expect(R_PAREN, "expected ')'");
-    addChild(node, new TreeNode(rparen.value, rparen.line));
+    addChild(node, leaf(rparen));
 
     addChild(node, parseBlock());
 
     return node;
 }
 
-TreeNode* CSTParser::parseParameters() {
-    TreeNode* node = new TreeNode("Parameters");
+NodeId CSTParser::parseParameters() {
+    NodeId node = makeNode(SYM_PARAMETERS);
 
-    if (match("void")) {
+    if (check(KEYWORD_VOID)) {
         Token voidTok = advance();
-        addChild(node, new TreeNode(voidTok.value, voidTok.line));
+        addChild(node, leaf(voidTok));
     } else {
         do {
             if (check(COMMA)) {
                 Token comma = advance();
-                addChild(node, new TreeNode(comma.value, comma.line));
+                addChild(node, leaf(comma));
             }
 
-            TreeNode* param = parseParameter();
+            NodeId param = parseParameter();
             addChild(node, param);
 
         } while (check(COMMA));
@@ -173,67 +253,53 @@ TreeNode* CSTParser::parseParameters() {
     return node;
 }
 
-TreeNode* CSTParser::parseParameter() {
-    TreeNode* node = new TreeNode("Parameter");
+NodeId CSTParser::parseParameter() {
+    NodeId node = makeNode(SYM_PARAMETER);
 
     Token typeTok = advance();
-    addChild(node, new TreeNode(typeTok.value, typeTok.line));
+    addChild(node, leaf(typeTok));
 
-    Token name = expect(IDENTIFIER, "expected parameter name");
-    if (isReservedWord(name.value)) {
-        cerr << "Syntax error on line " << name.line << ": reserved word \"" << name.value
-             << "\" cannot be used for the name of a variable." << endl;
-        exit(1);
+    Token name = expectName("expected parameter name");
+    if (isKeyword(name.type)) {
+        syntaxError(name, "reserved word \"" + string(text(name)) +
+                          "\" cannot be used for the name of a variable.");
     }
 
-    addChild(node, new TreeNode(name.value, name.line));
+    addChild(node, leaf(name));
 
     if (check(L_BRACKET)) {
         Token lbracket = advance();
-        addChild(node, new TreeNode(lbracket.value, lbracket.line));
+        addChild(node, leaf(lbracket));
 
         if (!check(R_BRACKET)) {
             Token size = advance();
-            addChild(node, new TreeNode(size.value, size.line));
+            addChild(node, leaf(size));
         }
 
         Token rbracket = expect(R_BRACKET, "expected ']'");
-        addChild(node, new TreeNode(rbracket.value, rbracket.line));
+        addChild(node, leaf(rbracket));
     }
 
     return node;
 }
 
-TreeNode* CSTParser::parseBlock() {
-    TreeNode* node = new TreeNode("Block");
-
-    Token lbrace = expect(L_BRACE, "expected '{'");
-    addChild(node, new TreeNode(lbrace.value, lbrace.line));
-
-    while (match("int") || match("char") || match("bool")) {
-        addChild(node, parseDeclaration());
-    }
-
-    while (!check(R_BRACE) && !check(END_OF_FILE)) {
-        addChild(node, parseStatement());
+NodeId CSTParser::parseBlock() {
+    if (!check(L_BRACE)) {
+        expect(L_BRACE, "expected '{'");
     }
-
-    Token rbrace = expect(R_BRACE, "expected '}'");
-    addChild(node, new TreeNode(rbrace.value, rbrace.line));
-
-    return node;
+    return parseStatement();
 }
 
-TreeNode* CSTParser::parseDeclaration() {
-    TreeNode* node = new TreeNode("Declaration");
+NodeId CSTParser::parseDeclaration() {
+    NodeId node = makeNode(SYM_DECLARATION);
 
     Token typeTok = advance();
-    addChild(node, new TreeNode(typeTok.value, typeTok.line));
+    addChild(node, leaf(typeTok));
 
     do {
         if (check(COMMA)) {
             Token comma = advance();
-            addChild(node, new TreeNode(comma.value, comma.line));
+            addChild(node, leaf(comma));
         }
 
         addChild(node, parseVariableDeclarator());
@@ -241,397 +307,417 @@ TreeNode* CSTParser::parseDeclaration() {
     } while (check(COMMA));
 
     Token semi = expect(SEMICOLON, "expected ';'");
-    addChild(node, new TreeNode(semi.value, semi.line));
+    addChild(node, leaf(semi));
 
     return node;
 }
 
-TreeNode* CSTParser::parseVariableDeclarator() {
-    TreeNode* node = new TreeNode("VarDecl");
+NodeId CSTParser::parseVariableDeclarator() {
+    NodeId node = makeNode(SYM_VAR_DECL);
 
-    Token name = expect(IDENTIFIER, "expected identifier");
+    Token name = expectName("expected identifier");
 
-    if (isReservedWord(name.value)) {
-        cerr << "Syntax error on line " << name.line << ": reserved word \"" << name.value
-             << "\" cannot be used for the name of a variable." << endl;
-        exit(1);
+    if (isKeyword(name.type)) {
+        syntaxError(name, "reserved word \"" + string(text(name)) +
+                          "\" cannot be used for the name of a variable.");
     }
-    addChild(node, new TreeNode(name.value, name.line));
+    addChild(node, leaf(name));
 
     if (check(L_BRACKET)) {
         Token lbracket = advance();
-        addChild(node, new TreeNode(lbracket.value, lbracket.line));
+        addChild(node, leaf(lbracket));
 
         Token size = advance();
 
         if (size.type == INTEGER) {
-            int sizeVal = stoi(size.value);
-            if (sizeVal <= 0) {
-                cerr << "Syntax error on line " << size.line << ": array declaration size must be a positive integer." << endl;
-                exit(1);
+            const Literal& sizeVal = literalOf(size);
+            if (sizeVal.overflow) {
+                syntaxError(size, "array declaration size is too large.");
+            }
+            if (sizeVal.value <= 0) {
+                syntaxError(size, "array declaration size must be a positive integer.");
             }
         }
         else if (size.type == MINUS) {
-            cerr << "Syntax error on line " << size.line << ": array declaration size must be a positive integer." << endl;
-            exit(1);
+            syntaxError(size, "array declaration size must be a positive integer.");
         }
 
-        addChild(node, new TreeNode(size.value, size.line));
+        addChild(node, leaf(size));
 
         Token rbracket = expect(R_BRACKET, "expected ']'");
-        addChild(node, new TreeNode(rbracket.value, rbracket.line));
+        addChild(node, leaf(rbracket));
     }
 
     return node;
 }
 
-TreeNode* CSTParser::parseStatement() {
-    if (match("if")) {
-        return parseIfStatement();
-    } else if (match("while")) {
-        return parseWhileStatement();
-    } else if (match("for")) {
-        return parseForStatement();
-    } else if (match("return")) {
-        return parseReturnStatement();
-    } else if (check(L_BRACE)) {
-        return parseBlock();
-    } else if (check(IDENTIFIER)) {
-        return parseExpressionStatement();
-    } else {
+NodeId CSTParser::parseStatement() {
+    const size_t base = frames.size();
+
+    for (;;) {
+        // Open the statement at the current token. Compound ones push a frame
+        // and go on to what they contain; done is NO_NODE until a statement
+        // (or an empty block's opening) is complete.
+        NodeId done = NO_NODE;
         Token tok = peek();
-        cerr << "Syntax error on line " << tok.line << ": unexpected token '" << tok.value << "'" << endl;
-        exit(1);
+        switch (tok.type) {
+            case KEYWORD_IF:
+                openIfStatement();
+                continue;
+            case KEYWORD_WHILE:
+                openWhileStatement();
+                continue;
+            case KEYWORD_FOR:
+                openForStatement();
+                continue;
+            case L_BRACE:
+                openBlock();
+                break;
+            case KEYWORD_RETURN:
+                done = parseReturnStatement();
+                break;
+            default:
+                if (checkName()) {
+                    done = parseExpressionStatement();
+                    break;
+                }
+                syntaxError(tok, "unexpected token '" + string(text(tok)) + "'");
+        }
+
+        // Hand it to the constructs waiting on it, closing each that is now
+        // complete, until one needs another statement
+        for (bool needStatement = false; !needStatement;) {
+            if (frames.size() == base) {
+                return done;
+            }
+
+            Frame& frame = frames.back();
+            NodeId node = frame.node;
+            addChild(node, done);
+
+            switch (frame.resume) {
+                case IF_THEN:
+                    if (check(KEYWORD_ELSE)) {
+                        Token elseTok = advance();
+                        addChild(node, leaf(elseTok));
+                        frame.resume = IF_ELSE;
+                        needStatement = true;
+                        continue;
+                    }
+                    break;
+                case BLOCK_BODY:
+                    if (!check(R_BRACE) && !check(END_OF_FILE)) {
+                        needStatement = true;
+                        continue;
+                    } else {
+                        Token rbrace = expect(R_BRACE, "expected '}'");
+                        addChild(node, leaf(rbrace));
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            frames.pop_back();
+            done = node;
+        }
     }
 }
 
-TreeNode* CSTParser::parseIfStatement() {
-    TreeNode* node = new TreeNode("IfStmt");
+void CSTParser::openIfStatement() {
+    NodeId node = makeNode(SYM_IF_STMT);
 
     Token ifTok = advance();
-    addChild(node, new TreeNode(ifTok.value, ifTok.line));
+    addChild(node, leaf(ifTok));
 
     Token lparen = expect(L_PAREN, "expected '('");
-    addChild(node, new TreeNode(lparen.value, lparen.line));
+    addChild(node, leaf(lparen));
 
     addChild(node, parseExpression());
 
     Token rparen = expect(R_PAREN, "expected ')'");
-    addChild(node, new TreeNode(rparen.value, rparen.line));
-
-    addChild(node, parseStatement());
+    addChild(node, leaf(rparen));
 
-    if (match("else")) {
-        Token elseTok = advance();
-        addChild(node, new TreeNode(elseTok.value, elseTok.line));
-        addChild(node, parseStatement());
-    }
-
-    return node;
+    frames.push_back({node, IF_THEN, 0});
 }
 
-TreeNode* CSTParser::parseWhileStatement() {
-    TreeNode* node = new TreeNode("WhileStmt");
+void CSTParser::openWhileStatement() {
+    NodeId node = makeNode(SYM_WHILE_STMT);
 
     Token whileTok = advance();
-    addChild(node, new TreeNode(whileTok.value, whileTok.line));
+    addChild(node, leaf(whileTok));
 
     Token lparen = expect(L_PAREN, "expected '('");
-    addChild(node, new TreeNode(lparen.value, lparen.line));
+    addChild(node, leaf(lparen));
 
     addChild(node, parseExpression());
 
     Token rparen = expect(R_PAREN, "expected ')'");
-    addChild(node, new TreeNode(rparen.value, rparen.line));
-
-    addChild(node, parseStatement());
+    addChild(node, leaf(rparen));
 
-    return node;
+    frames.push_back({node, LOOP_BODY, 0});
 }
 
-TreeNode* CSTParser::parseForStatement() {
-    TreeNode* node = new TreeNode("ForStmt");
+void CSTParser::openForStatement() {
+    NodeId node = makeNode(SYM_FOR_STMT);
 
     Token forTok = advance();
-    addChild(node, new TreeNode(forTok.value, forTok.line));
+    addChild(node, leaf(forTok));
 
     Token lparen = expect(L_PAREN, "expected '('");
-    addChild(node, new TreeNode(lparen.value, lparen.line));
+    addChild(node, leaf(lparen));
 
     addChild(node, parseAssignment());
 
     Token semi1 = expect(SEMICOLON, "expected ';'");
-    addChild(node, new TreeNode(semi1.value, semi1.line));
+    addChild(node, leaf(semi1));
 
     addChild(node, parseExpression());
 
     Token semi2 = expect(SEMICOLON, "expected ';'");
-    addChild(node, new TreeNode(semi2.value, semi2.line));
+    addChild(node, leaf(semi2));
 
     addChild(node, parseAssignment());
 
     Token rparen = expect(R_PAREN, "expected ')'");
-    addChild(node, new TreeNode(rparen.value, rparen.line));
+    addChild(node, leaf(rparen));
 
-    addChild(node, parseStatement());
+    frames.push_back({node, LOOP_BODY, 0});
+}
 
-    return node;
+void CSTParser::openBlock() {
+    NodeId node = makeNode(SYM_BLOCK);
+
+    Token lbrace = advance();
+    addChild(node, leaf(lbrace));
+
+    while (check(KEYWORD_INT) || check(KEYWORD_CHAR) || check(KEYWORD_BOOL)) {
+        addChild(node, parseDeclaration());
+    }
+
+    frames.push_back({node, BLOCK_BODY, 0});
 }
 
-TreeNode* CSTParser::parseReturnStatement() {
-    TreeNode* node = new TreeNode("ReturnStmt");
+NodeId CSTParser::parseReturnStatement() {
+    NodeId node = makeNode(SYM_RETURN_STMT);
 
     Token retTok = advance();
-    addChild(node, new TreeNode(retTok.value, retTok.line));
+    addChild(node, leaf(retTok));
 
     addChild(node, parseExpression());
 
     Token semi = expect(SEMICOLON, "expected ';'");
-    addChild(node, new TreeNode(semi.value, semi.line));
+    addChild(node, leaf(semi));
 
     return node;
 }
 
-TreeNode* CSTParser::parseExpressionStatement() {
+NodeId CSTParser::parseExpressionStatement() {
     Token name = peek();
-
-    size_t saved = current;
-    advance();
-    Token lookahead = peek();
-    current = saved;
+    Token lookahead = peek(1);
 
     if (lookahead.type == ASSIGNMENT_OPERATOR || lookahead.type == L_BRACKET) {
-        TreeNode* node = parseAssignment();
+        NodeId node = parseAssignment();
 
         Token semi = expect(SEMICOLON, "expected ';'");
-        addChild(node, new TreeNode(semi.value, semi.line));
+        addChild(node, leaf(semi));
 
         return node;
 
     } else if (lookahead.type == L_PAREN) {
-        TreeNode* node = parseFunctionCall();
+        NodeId node = parseFunctionCall();
         Token semi = expect(SEMICOLON, "expected ';'");
-        TreeNode* wrapper = new TreeNode("ExprStmt");
+        NodeId wrapper = makeNode(SYM_EXPR_STMT);
 
         addChild(wrapper, node);
-        addChild(wrapper, new TreeNode(semi.value, semi.line));
+        addChild(wrapper, leaf(semi));
 
         return wrapper;
     } else {
-        cerr << "Syntax error on line " << name.line << ": unexpected token" << endl;
-        exit(1);
+        syntaxError(name, "unexpected token");
     }
 }
 
-TreeNode* CSTParser::parseAssignment() {
-    TreeNode* node = new TreeNode("Assignment");
+NodeId CSTParser::parseAssignment() {
+    NodeId node = makeNode(SYM_ASSIGNMENT);
 
-    Token name = expect(IDENTIFIER, "expected identifier");
-    addChild(node, new TreeNode(name.value, name.line));
+    Token name = expectName("expected identifier");
+    addChild(node, leaf(name));
 
     if (check(L_BRACKET)) {
         Token lbracket = advance();
-        addChild(node, new TreeNode(lbracket.value, lbracket.line));
+        addChild(node, leaf(lbracket));
 
         addChild(node, parseExpression());
 
         Token rbracket = expect(R_BRACKET, "expected ']'");
-        addChild(node, new TreeNode(rbracket.value, rbracket.line));
+        addChild(node, leaf(rbracket));
     }
 
     Token eq = expect(ASSIGNMENT_OPERATOR, "expected '='");
-    addChild(node, new TreeNode(eq.value, eq.line));
+    addChild(node, leaf(eq));
 
     addChild(node, parseExpression());
 
     return node;
 }
 
-TreeNode* CSTParser::parseExpression() {
-    return parseLogicalOr();
-}
-
-TreeNode* CSTParser::parseLogicalOr() {
-    TreeNode* left = parseLogicalAnd();
-
-    while (check(BOOLEAN_OR)) {
-        Token op = advance();
-        TreeNode* binOpNode = new TreeNode("BinaryOp");
-        addChild(binOpNode, left);
-        addChild(binOpNode, new TreeNode(op.value, op.line));
-        TreeNode* right = parseLogicalAnd();
-        addChild(binOpNode, right);
-        left = binOpNode;
-    }
-
-    return left;
-}
-
-TreeNode* CSTParser::parseLogicalAnd() {
-    TreeNode* left = parseEquality();
-
-    while (check(BOOLEAN_AND)) {
-        Token op = advance();
-        TreeNode* node = new TreeNode("BinaryOp");
-        addChild(node, left);
-        addChild(node, new TreeNode(op.value, op.line));
-        addChild(node, parseEquality());
-        left = node;
-    }
-
-    return left;
-}
-
-TreeNode* CSTParser::parseEquality() {
-    TreeNode* left = parseRelational();
-
-    while (check(BOOLEAN_EQUAL) || check(BOOLEAN_NOT_EQUAL)) {
-        Token op = advance();
-        TreeNode* node = new TreeNode("BinaryOp");
-        addChild(node, left);
-        addChild(node, new TreeNode(op.value, op.line));
-        addChild(node, parseRelational());
-        left = node;
-    }
-
-    return left;
-}
-
-TreeNode* CSTParser::parseRelational() {
-    TreeNode* left = parseAdditive();
-
-    while (check(LT) || check(GT) || check(LT_EQUAL) || check(GT_EQUAL)) {
-        Token op = advance();
-        TreeNode* node = new TreeNode("BinaryOp");
-        addChild(node, left);
-        addChild(node, new TreeNode(op.value, op.line));
-        addChild(node, parseAdditive());
-        left = node;
-    }
-
-    return left;
-}
-
-TreeNode* CSTParser::parseAdditive() {
-    TreeNode* left = parseMultiplicative();
-
-    while (check(PLUS) || check(MINUS)) {
-        Token op = advance();
-        TreeNode* node = new TreeNode("BinaryOp");
-        addChild(node, left);
-        addChild(node, new TreeNode(op.value, op.line));
-        addChild(node, parseMultiplicative());
-        left = node;
-    }
+NodeId CSTParser::parseExpression() {
+    const size_t base = frames.size();
+    uint8_t minPrecedence = 1;
+
+    for (;;) {
+        // Open an operand; prefix operators wait for it on frames
+        while (check(BOOLEAN_NOT) || check(MINUS)) {
+            Token op = advance();
+            NodeId node = makeNode(SYM_UNARY_OP);
+            addChild(node, leaf(op));
+            frames.push_back({node, UNARY_OPERAND, minPrecedence});
+        }
 
-    return left;
-}
+        NodeId done = openPrimary(minPrecedence);
+        if (done == NO_NODE) {
+            minPrecedence = 1;
+            continue;
+        }
 
-TreeNode* CSTParser::parseMultiplicative() {
-    TreeNode* left = parseUnary();
+        // done is a complete operand, or a complete expression at level
+        // minPrecedence; hand it on until something needs another expression
+        for (;;) {
+            if (frames.size() > base && frames.back().resume == UNARY_OPERAND) {
+                NodeId node = frames.back().node;
+                frames.pop_back();
+                addChild(node, done);
+                done = node;
+                continue;
+            }
 
-    while (check(ASTERISK) || check(DIVIDE) || check(MODULO)) {
-        Token op = advance();
-        TreeNode* node = new TreeNode("BinaryOp");
-        addChild(node, left);
-        addChild(node, new TreeNode(op.value, op.line));
-        addChild(node, parseUnary());
-        left = node;
-    }
+            int precedence = binaryPrecedence[peek().type];
+            if (precedence >= minPrecedence) {
+                Token op = advance();
+                NodeId node = makeNode(SYM_BINARY_OP);
+                addChild(node, done);
+                addChild(node, leaf(op));
+                frames.push_back({node, RIGHT_OPERAND, minPrecedence});
+                minPrecedence = precedence + 1;
+                break;
+            }
 
-    return left;
-}
+            if (frames.size() == base) {
+                return done;
+            }
 
-TreeNode* CSTParser::parseUnary() {
-    if (check(BOOLEAN_NOT) || check(MINUS)) {
-        Token op = advance();
-        TreeNode* node = new TreeNode("UnaryOp");
-        addChild(node, new TreeNode(op.value, op.line));
-        addChild(node, parseUnary());
-        return node;
+            Frame frame = frames.back();
+            frames.pop_back();
+            addChild(frame.node, done);
+            minPrecedence = frame.minPrecedence;
+
+            if (frame.resume == CALL_ARGUMENT) {
+                if (check(COMMA)) {
+                    Token comma = advance();
+                    addChild(frame.node, leaf(comma));
+                    frames.push_back(frame);
+                    minPrecedence = 1;
+                    break;
+                }
+                Token rparen = expect(R_PAREN, "expected ')'");
+                addChild(frame.node, leaf(rparen));
+            } else if (frame.resume == ARRAY_INDEX) {
+                Token rbracket = expect(R_BRACKET, "expected ']'");
+                addChild(frame.node, leaf(rbracket));
+            } else if (frame.resume == PAREN_INNER) {
+                Token rparen = expect(R_PAREN, "expected ')'");
+                addChild(frame.node, leaf(rparen));
+            }
+            done = frame.node;
+        }
     }
-
-    return parsePrimary();
 }
 
-TreeNode* CSTParser::parsePrimary() {
+NodeId CSTParser::openPrimary(uint8_t minPrecedence) {
     if (check(INTEGER)) {
         Token num = advance();
-        return new TreeNode(num.value, num.line);
+        return leaf(num);
 
-    } else if (check(IDENTIFIER)) {
-        size_t saved = current;
-        Token name = advance();
-        Token next = peek();
-        current = saved;
+    } else if (checkName()) {
+        Token name = peek();
+        Token next = peek(1);
 
         if (next.type == L_PAREN) {
-            return parseFunctionCall();
-        } else if (next.type == L_BRACKET) {
             advance();
-            TreeNode* node = new TreeNode("ArrayAccess");
-            addChild(node, new TreeNode(name.value, name.line));
+            NodeId node = makeNode(SYM_FUNCTION_CALL);
+            addChild(node, leaf(name));
 
-            Token lbracket = advance();
-            addChild(node, new TreeNode(lbracket.value, lbracket.line));
+            Token lparen = advance();
+            addChild(node, leaf(lparen));
 
-            addChild(node, parseExpression());
+            if (check(R_PAREN)) {
+                Token rparen = advance();
+                addChild(node, leaf(rparen));
+                return node;
+            }
+            if (check(COMMA)) {
+                Token comma = advance();
+                addChild(node, leaf(comma));
+            }
+            frames.push_back({node, CALL_ARGUMENT, minPrecedence});
+            return NO_NODE;
+        } else if (next.type == L_BRACKET) {
+            advance();
+            NodeId node = makeNode(SYM_ARRAY_ACCESS);
+            addChild(node, leaf(name));
 
-            Token rbracket = expect(R_BRACKET, "expected ']'");
-            addChild(node, new TreeNode(rbracket.value, rbracket.line));
+            Token lbracket = advance();
+            addChild(node, leaf(lbracket));
 
-            return node;
+            frames.push_back({node, ARRAY_INDEX, minPrecedence});
+            return NO_NODE;
         } else {
             advance();
-            return new TreeNode(name.value, name.line);
+            return leaf(name);
         }
     } else if (check(SINGLE_QUOTED_STRING)) {
         Token str = advance();
-        TreeNode* node = new TreeNode("CharLiteral");
-        string content = str.value.substr(1, str.value.length() - 2);
-        addChild(node, new TreeNode("'", str.line));
-        addChild(node, new TreeNode(content, str.line));
-        addChild(node, new TreeNode("'", str.line));
+        NodeId node = makeNode(SYM_CHAR_LITERAL);
+        addChild(node, makeNode(SYM_SINGLE_QUOTE, str.offset));
+        addChild(node, makeNode(literalOf(str).content, str.offset + 1));
+        addChild(node, makeNode(SYM_SINGLE_QUOTE, str.offset + str.length - 1));
         return node;
 
     } else if (check(DOUBLE_QUOTED_STRING)) {
         Token str = advance();
-        TreeNode* node = new TreeNode("StringLiteral");
-        string content = str.value.substr(1, str.value.length() - 2);
-        addChild(node, new TreeNode("\"", str.line));
-        addChild(node, new TreeNode(content, str.line));
-        addChild(node, new TreeNode("\"", str.line));
+        NodeId node = makeNode(SYM_STRING_LITERAL);
+        addChild(node, makeNode(SYM_DOUBLE_QUOTE, str.offset));
+        addChild(node, makeNode(literalOf(str).content, str.offset + 1));
+        addChild(node, makeNode(SYM_DOUBLE_QUOTE, str.offset + str.length - 1));
         return node;
 
     } else if (check(L_PAREN)) {
         Token lparen = advance();
-        TreeNode* node = new TreeNode("ParenExpr");
-        addChild(node, new TreeNode(lparen.value, lparen.line));
-        addChild(node, parseExpression());
-        Token rparen = expect(R_PAREN, "expected ')'");
-        addChild(node, new TreeNode(rparen.value, rparen.line));
-        return node;
+        NodeId node = makeNode(SYM_PAREN_EXPR);
+        addChild(node, leaf(lparen));
+        frames.push_back({node, PAREN_INNER, minPrecedence});
+        return NO_NODE;
     } else {
         Token tok = peek();
-        cerr << "Syntax error on line " << tok.line << ": unexpected token '" << tok.value << "'" << endl;
-        exit(1);
+        syntaxError(tok, "unexpected token '" + string(text(tok)) + "'");
     }
 }
 
-TreeNode* CSTParser::parseFunctionCall() {
-    TreeNode* node = new TreeNode("FunctionCall");
+NodeId CSTParser::parseFunctionCall() {
+    NodeId node = makeNode(SYM_FUNCTION_CALL);
 
-    Token name = expect(IDENTIFIER, "expected function name");
-    addChild(node, new TreeNode(name.value, name.line));
+    Token name = expectName("expected function name");
+    addChild(node, leaf(name));
 
     Token lparen = expect(L_PAREN, "expected '('");
-    addChild(node, new TreeNode(lparen.value, lparen.line));
+    addChild(node, leaf(lparen));
 
     if (!check(R_PAREN)) {
         do {
             if (check(COMMA)) {
                 Token comma = advance();
-                addChild(node, new TreeNode(comma.value, comma.line));
+                addChild(node, leaf(comma));
             }
             addChild(node, parseExpression());
         }
@@ -639,81 +725,402 @@ TreeNode* CSTParser::parseFunctionCall() {
     }
 
     Token rparen = expect(R_PAREN, "expected ')'");
-    addChild(node, new TreeNode(rparen.value, rparen.line));
+    addChild(node, leaf(rparen));
 
     return node;
 }
 
-TreeNode* CSTParser::parse() {
-    return parseProgram();
+TreeRef CSTParser::parse() {
+    return parse(owned);
 }
 
-void CSTParser::printTree(TreeNode* node, int depth) {
-    if (!node) return;
-    for (int i = 0; i < depth; i++) cout << "  ";
-    cout << node->value << endl;
-    printTree(node->leftChild, depth + 1);
-    printTree(node->rightSibling, depth);
+TreeRef CSTParser::parse(ParseResult& result) {
+    result.release();
+    nodes = &result.nodes;
+    // A reused result already knows about how many nodes to expect
+    lastChild.reserve(result.nodes.capacity());
+    NodeId root = parseProgram(result.units);
+    nodes = nullptr;
+    lastChild.clear();
+    result.root = TreeRef(result.nodes.data(), root);
+    return result.root;
+}
+
+TreeRef CSTParser::parseUnit(ParseResult& result) {
+    result.release();
+    if (check(END_OF_FILE)) {
+        return result.root;
+    }
+    nodes = &result.nodes;
+    lastChild.reserve(result.nodes.capacity());
+    NodeId unit = parseTopLevel();
+    nodes = nullptr;
+    lastChild.clear();
+    result.root = TreeRef(result.nodes.data(), unit);
+    return result.root;
+}
+
+namespace {
+
+// Source bytes per thread below which the threads cost more than they save
+const size_t MIN_PARALLEL_RUN = 1 << 18;
+
+}
+
+unsigned CSTParser::parallelRuns(size_t bytes, unsigned threads) {
+    if (threads == 0) {
+        threads = thread::hardware_concurrency();
+    }
+    return static_cast<unsigned>(max<size_t>(1, min<size_t>(threads, bytes / MIN_PARALLEL_RUN)));
 }
 
-void CSTParser::printCST(vector<Token>& tokens, ofstream& out) {
+// Every top-level unit is parsed from the state the serial parser is in
+// between two of them, so a run that starts where the serial parser starts a
+// unit builds the nodes it would, in the same order; only their indices are
+// offset by the nodes before the run. A worker parses whole units until it
+// passes the start of the next run, and it sees the whole token stream past
+// that, so a unit that runs on (or an error found by looking past its end)
+// comes out as it would serially. Runs are then chained from the first one,
+// each continuing at the run that starts where it stopped: the first syntax
+// error on the chain is the serial parser's first error. A prescan misled by
+// malformed input can leave a run stopping where none starts; the tokens are
+// then parsed again serially.
+TreeRef CSTParser::parseParallel(string_view src, ParseResult& result, unsigned threads) {
+    size_t runCount = parallelRuns(src.size(), threads);
+    if (runCount <= 1) {
+        return CSTParser(src).parse(result);
+    }
+
+    // On a lexical error the streaming parser decides whether it or an
+    // earlier syntax error is reported
+    TokenStore toks;
+    if (!Tokenizer::tryTokenizeParallel(src, toks, threads)) {
+        return CSTParser(src).parse(result);
+    }
+
+    // Runs begin at routines; the global declarations between two go with
+    // the run before them
+    vector<size_t> starts = toks.routineStarts();
+    vector<size_t> bounds(1, 0);
+    for (size_t k = 1; k < runCount; k++) {
+        auto at = lower_bound(starts.begin(), starts.end(), toks.size() / runCount * k);
+        if (at != starts.end() && *at > bounds.back()) {
+            bounds.push_back(*at);
+        }
+    }
+    runCount = bounds.size();
+    if (runCount <= 1) {
+        return CSTParser(toks, src).parse(result);
+    }
+
+    struct Run {
+        vector<CSTNode> nodes;
+        vector<NodeId> units;   // roots of the units parsed, in order
+        size_t stop;            // index of the token the run stopped at
+        bool atEnd;             // stopped at the end of input
+        bool failed;
+        SyntaxError error;
+    };
+    vector<Run> runs(runCount);
+    vector<thread> workers;
+
+    for (size_t k = 0; k < runCount; k++) {
+        workers.emplace_back([&, k]() {
+            Run& run = runs[k];
+            size_t end = k + 1 < runCount ? bounds[k + 1] : toks.size();
+            CSTParser parser(toks, src, bounds[k]);
+            parser.deferErrors = true;
+            parser.nodes = &run.nodes;
+            run.failed = false;
+            // About three nodes are made for every two tokens. The first run's
+            // array becomes the tree, with "Program" first, so it is sized for
+            // all of them; untouched capacity costs address space only.
+            run.nodes.reserve((k == 0 ? toks.size() : end - bounds[k]) * 3 / 2 + 1);
+            if (k == 0) {
+                parser.makeNode(SYM_PROGRAM);
+            }
+            try {
+                while (parser.position() < end && !parser.check(END_OF_FILE)) {
+                    run.units.push_back(parser.parseTopLevel());
+                }
+            } catch (const SyntaxError& e) {
+                run.failed = true;
+                run.error = e;
+            }
+            run.stop = parser.position();
+            run.atEnd = parser.check(END_OF_FILE);
+        });
+    }
+    for (size_t k = 0; k < workers.size(); k++) {
+        workers[k].join();
+    }
+
+    // Walk the chain of runs that stopped where the next one begins
+    vector<size_t> chain;
+    size_t total = 0;
+    for (size_t k = 0;;) {
+        const Run& run = runs[k];
+        if (run.failed) {
+            run.error.report();
+        }
+        chain.push_back(k);
+        total += run.nodes.size();
+        if (run.atEnd) {
+            break;
+        }
+        k = lower_bound(bounds.begin(), bounds.end(), run.stop) - bounds.begin();
+        if (k == runCount || bounds[k] != run.stop) {
+            return CSTParser(toks, src).parse(result);
+        }
+    }
+    toks = TokenStore();
+
+    result.release();
+    vector<CSTNode>& tree = result.nodes;
+    tree = move(runs[0].nodes);
+    tree.reserve(total);
+    NodeId lastUnit = NO_NODE;
+    for (size_t k : chain) {
+        Run& run = runs[k];
+        NodeId base = 0;
+        if (k == 0) {
+            run.units.push_back(static_cast<NodeId>(tree.size()));
+        } else {
+            run.units.push_back(static_cast<NodeId>(run.nodes.size()));
+            base = static_cast<NodeId>(tree.size());
+            for (CSTNode node : run.nodes) {
+                if (node.firstChild != NO_NODE) {
+                    node.firstChild += base;
+                }
+                if (node.nextSibling != NO_NODE) {
+                    node.nextSibling += base;
+                }
+                tree.push_back(node);
+            }
+            vector<CSTNode>().swap(run.nodes);
+        }
+
+        // The run's units end where the next begins; the last, where the run does
+        for (size_t u = 0; u + 1 < run.units.size(); u++) {
+            NodeId id = run.units[u] + base;
+            if (lastUnit == NO_NODE) {
+                tree[0].firstChild = id;
+            } else {
+                tree[lastUnit].nextSibling = id;
+            }
+            lastUnit = id;
+            result.units.push_back({id, run.units[u + 1] + base});
+        }
+    }
+    result.root = TreeRef(tree.data(), 0);
+    return result.root;
+}
+
+// The last node of a unit is the leaf of its closing ';' or '}'. Neither
+// can run on into what follows, so parsing can restart right after one.
+TreeRef CSTParser::reparse(IncrementalTokenizer& source, ParseResult& result, size_t offset, size_t length,
+                           string_view replacement) {
+    source.edit(offset, length, replacement);
+    if (!result.root || source.hasError()) {
+        return CSTParser(source.text()).parse(result);
+    }
+
+    vector<CSTNode>& tree = result.nodes;
+    vector<ParseResult::Unit>& units = result.units;
+    auto startOf = [&](size_t k) {
+        return tree[units[k].root].offset;
+    };
+    auto endOf = [&](size_t k) {
+        return startOf(k) + tree[units[k].end - 1].offset + 1;
+    };
+
+    // Units [0, kept) end before the edit and are left alone; units from
+    // after on start past it, and parsing may rejoin the old tree at one
+    size_t kept = 0;
+    size_t high = units.size();
+    while (kept < high) {
+        size_t mid = (kept + high) / 2;
+        if (endOf(mid) <= offset) {
+            kept = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    size_t after = kept;
+    high = units.size();
+    while (after < high) {
+        size_t mid = (after + high) / 2;
+        if (startOf(mid) < offset + length) {
+            after = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    int64_t shift = static_cast<int64_t>(replacement.size()) - static_cast<int64_t>(length);
+    size_t restart = kept > 0 ? endOf(kept - 1) : 0;
+    size_t from = 0;
+    high = source.size();
+    while (from < high) {
+        size_t mid = (from + high) / 2;
+        if (source[mid].offset < restart) {
+            from = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    // The parser reads the text past restart only, so the text's gap need
+    // not be closed; an error it finds is left to a full parse to report
+    CSTParser parser(source, source.textFrom(restart), from);
+    parser.deferErrors = true;
+    vector<CSTNode> fresh;
+    vector<ParseResult::Unit> freshUnits;
+    parser.nodes = &fresh;
+    size_t resume = after;
+    try {
+        for (;;) {
+            const Token& tok = parser.peek();
+            if (tok.type == END_OF_FILE) {
+                resume = units.size();
+                break;
+            }
+            while (resume < units.size() && startOf(resume) + shift < tok.offset) {
+                resume++;
+            }
+            if (resume < units.size() && startOf(resume) + shift == tok.offset) {
+                break;
+            }
+            NodeId unit = parser.parseTopLevel();
+            freshUnits.push_back({unit, static_cast<NodeId>(fresh.size())});
+        }
+    } catch (const SyntaxError&) {
+        return CSTParser(source.text()).parse(result);
+    }
+
+    // The fresh units go after every node there is, and the nodes of units
+    // [kept, resume) are left behind; units past those keep their nodes,
+    // whose offsets count from the unit's start, so only their roots move.
+    NodeId base = static_cast<NodeId>(tree.size());
+    for (CSTNode node : fresh) {
+        if (node.firstChild != NO_NODE) {
+            node.firstChild += base;
+        }
+        if (node.nextSibling != NO_NODE) {
+            node.nextSibling += base;
+        }
+        tree.push_back(node);
+    }
+    for (ParseResult::Unit& unit : freshUnits) {
+        unit.root += base;
+        unit.end += base;
+    }
+    for (size_t k = kept; k < resume; k++) {
+        result.dead += units[k].end - units[k].root;
+    }
+    if (shift != 0) {
+        for (size_t k = resume; k < units.size(); k++) {
+            tree[units[k].root].offset = static_cast<uint32_t>(startOf(k) + shift);
+        }
+    }
+
+    // Relink the units: the kept ones, the fresh ones, then the reused ones
+    NodeId next = resume < units.size() ? units[resume].root : NO_NODE;
+    for (size_t k = freshUnits.size(); k-- > 0;) {
+        tree[freshUnits[k].root].nextSibling = next;
+        next = freshUnits[k].root;
+    }
+    if (kept > 0) {
+        tree[units[kept - 1].root].nextSibling = next;
+    } else {
+        tree[0].firstChild = next;
+    }
+    units.erase(units.begin() + kept, units.begin() + resume);
+    units.insert(units.begin() + kept, freshUnits.begin(), freshUnits.end());
+
+    result.root = TreeRef(tree.data(), 0);
+    if (result.dead > tree.size() / 2) {
+        result.compact();
+    }
+    return result.root;
+}
+
+void CSTParser::printTree(TreeRef node, int depth) {
+    // Preorder: a node, its children one level deeper, then its siblings
+    vector<pair<TreeRef, int>> pending;
+    if (node) pending.push_back({node, depth});
+    while (!pending.empty()) {
+        auto [n, d] = pending.back();
+        pending.pop_back();
+        for (int i = 0; i < d; i++) cout << "  ";
+        cout << Interner::spelling(n->value) << endl;
+        if (n->rightSibling) pending.push_back({n->rightSibling, d});
+        if (n->leftChild) pending.push_back({n->leftChild, d + 1});
+    }
+}
+
+void CSTParser::printCST(vector<Token>& tokens, const vector<Token>& trivia, string_view source, ofstream& out) {
+    LineTable lines(source);
     int currentLine = 0;
     bool firstOnLine = true;
+    size_t nextTrivia = 0;
 
     for (const Token& tok : tokens) {
-        if (tok.type == WHITESPACE || tok.type == END_OF_FILE) {
-            continue;
-        }
-
-        if (tok.type == NEWLINE) {
-            if (!firstOnLine) {
+        // Replay the line breaks that precede this token in the source
+        while (nextTrivia < trivia.size() && trivia[nextTrivia].offset < tok.offset) {
+            if (trivia[nextTrivia].type == NEWLINE && !firstOnLine) {
                 out << endl;
                 currentLine++;
                 firstOnLine = true;
             }
+            nextTrivia++;
+        }
+
+        if (tok.type == END_OF_FILE) {
             continue;
         }
+        int line = lines.line(tok.offset);
 
         if (tok.type == DOUBLE_QUOTED_STRING) {
-            if (tok.line != currentLine) {
+            if (line != currentLine) {
                 if (!firstOnLine) {
                     out << endl;
                 }
-                currentLine = tok.line;
+                currentLine = line;
                 firstOnLine = true;
             }
 
             if (!firstOnLine) {
                 out << "   ";
             }
-            string content = tok.value.substr(1, tok.value.length() - 2);
+            string_view content = tok.text(source).substr(1, tok.length - 2);
             out << "\"   " << content << "   \"";
             firstOnLine = false;
 
         } else if (tok.type == SINGLE_QUOTED_STRING) {
-            if (tok.line != currentLine) {
+            if (line != currentLine) {
                 if (!firstOnLine) out << endl;
-                currentLine = tok.line;
+                currentLine = line;
                 firstOnLine = true;
             }
 
             if (!firstOnLine) {
                 out << "   ";
             }
-            string content = tok.value.substr(1, tok.value.length() - 2);
+            string_view content = tok.text(source).substr(1, tok.length - 2);
             out << "'   " << content << "   '";
             firstOnLine = false;
         } else {
-            if (tok.line != currentLine) {
+            if (line != currentLine) {
                 if (!firstOnLine) out << endl;
-                currentLine = tok.line;
+                currentLine = line;
                 firstOnLine = true;
             }
 
             if (!firstOnLine) {
                 out << "   ";
             }
-            out << tok.value;
+            out << tok.text(source);
             firstOnLine = false;
         }
     }
@@ -722,11 +1129,5 @@ void CSTParser::printCST(vector<Token>& tokens, ofstream& out) {
 }
 
 bool CSTParser::isReservedWord(const string& word) {
-    const set<string> reserved = {
-        "int", "char", "void", "bool",
-        "function", "procedure", "if", "else", "while", "for", "return",
-        "printf", "TRUE", "FALSE"
-    };
-
-    return reserved.find(word) != reserved.end();
+    return Tokenizer::keywordType(word) != IDENTIFIER;
 }
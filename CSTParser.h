@@ -2,77 +2,267 @@
 #define CSTPARSER_H
 
 #include "Tokenizer.h"
+#include "IncrementalTokenizer.h"
+#include "LiteralPool.h"
+#include <array>
+#include <cstddef>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <fstream>
 
 using namespace std;
 
+// How tightly each binary operator binds, loosest first; 0 for every token
+// that is not one, which ends any expression
+constexpr array<int, END_OF_FILE + 1> buildBinaryPrecedence() {
+    array<int, END_OF_FILE + 1> p{};
+    p[BOOLEAN_OR] = 1;
+    p[BOOLEAN_AND] = 2;
+    p[BOOLEAN_EQUAL] = p[BOOLEAN_NOT_EQUAL] = 3;
+    p[LT] = p[GT] = p[LT_EQUAL] = p[GT_EQUAL] = 4;
+    p[PLUS] = p[MINUS] = 5;
+    p[ASTERISK] = p[DIVIDE] = p[MODULO] = 6;
+    return p;
+}
+
+inline constexpr array<int, END_OF_FILE + 1> binaryPrecedence = buildBinaryPrecedence();
+
+// Index of a node in a CST; NO_NODE stands for no node
+typedef uint32_t NodeId;
+const NodeId NO_NODE = UINT32_MAX;
+
+/**
+ * Description: One node of the CST as it is stored. All nodes of a tree sit in
+ *              one array and name their first child and next sibling by index
+ *              (the left-child, right-sibling layout), so a node is 16 bytes
+ *              and the tree is a single allocation. Offsets count from the start
+ *              of the top-level unit (routine or global declaration) a node is
+ *              in, so an edit before a unit moves it without touching its nodes.
+ * Fields:      value: The interned spelling (token value or node type such as SYM_BLOCK)
+ *              offset: Where this element starts, from the start of its unit, or
+ *                      NO_OFFSET for nodes that stand for no single token; the
+ *                      root of a unit holds the byte offset where the unit starts
+ *              firstChild, nextSibling: NO_NODE when there is none
+ *
+ */
+struct CSTNode {
+    Symbol value;
+    uint32_t offset;
+    NodeId firstChild;
+    NodeId nextSibling;
+};
+
+struct TreeFields;
+
+/**
+ * Description: Read-only handle on a CST node, used the way pointers to tree nodes
+ *              are: node->value, node->offset, node->leftChild and node->rightSibling
+ *              (which are handles again), a null handle for no node, and if (node).
+ *              node->offset is the byte offset in the source: a handle carries
+ *              the start of the unit it is in, and a unit's root, which stands
+ *              for no single token, reads as NO_OFFSET.
+ * Pre:         The tree it points into must not be released or reparsed while the
+ *              handle is in use.
+ *
+ */
+class TreeRef {
+public:
+    TreeRef(nullptr_t = nullptr) : nodes(nullptr), index(NO_NODE), base(0) {}
+    TreeRef(const CSTNode* nodes, NodeId index, uint32_t base = 0)
+        : nodes(index == NO_NODE ? nullptr : nodes), index(index), base(base) {}
+
+    explicit operator bool() const { return index != NO_NODE; }
+    bool operator==(const TreeRef& other) const { return nodes == other.nodes && index == other.index; }
+    bool operator!=(const TreeRef& other) const { return !(*this == other); }
+
+    // A copy of the node's fields, with its links as handles
+    TreeFields operator->() const;
+
+    NodeId id() const { return index; }
+
+private:
+    const CSTNode* nodes;
+    NodeId index;
+    uint32_t base;  // where the unit holding the node starts
+};
+
+struct TreeFields {
+    Symbol value;
+    uint32_t offset;
+    TreeRef leftChild;
+    TreeRef rightSibling;
+
+    const TreeFields* operator->() const { return this; }
+};
+
+inline TreeFields TreeRef::operator->() const {
+    const CSTNode& node = nodes[index];
+    if (node.offset == NO_OFFSET) {
+        return {node.value, NO_OFFSET, TreeRef(nodes, node.firstChild, base), TreeRef(nodes, node.nextSibling, base)};
+    }
+    if (node.firstChild != NO_NODE) {
+        // A unit's root: the one node with both an offset and children
+        return {node.value, NO_OFFSET, TreeRef(nodes, node.firstChild, node.offset),
+                TreeRef(nodes, node.nextSibling, base)};
+    }
+    return {node.value, node.offset + base, nullptr, TreeRef(nodes, node.nextSibling, base)};
+}
+
 /**
- * Description: COntructor for TreeNode structure. Creates a node in the CST with
- *              the given value and line number
- * Params:      Val: The string value stored in node(token val or node type)
- *              ln: The line number where this element appears in source code
- * Pre:         Val: can be any string (token value, keyword, or node type name)
- *              ln: should be >= 0
- * Post:        Creates a new TreeNode with the specified value and line number
- *              leftChild is initialized to nullptr
- *              rightSibling uis initialized to nullptr
- * Returns:     N/A (COnstuvtor)
+ * Description: Owns the nodes of one parsed CST. They are one array, in the order
+ *              the parser made them, so the whole tree is freed at once. The
+ *              nodes of each top-level unit are contiguous. CSTParser::reparse()
+ *              adds the units it makes at the end and leaves the ones they
+ *              replace in place, unreachable, until they are half the array;
+ *              then the units are packed back into source order.
+ * Pre:         Pass the same object to CSTParser::parse() again to reuse its
+ *              memory; the previous tree is released first.
+ * Post:        root is the Program node of the last parse, or null
+ *              Every node of the tree is freed by release() or the destructor
  *
  */
-struct TreeNode {
-    string value;
-    int line;
-    TreeNode* leftChild;
-    TreeNode* rightSibling;
+class ParseResult {
+public:
+    TreeRef root;
+
+    ParseResult();
+
+    ParseResult(const ParseResult&) = delete;
+    ParseResult& operator=(const ParseResult&) = delete;
 
-    TreeNode(string val, int ln = 0);
+    // Frees every node of the tree in one step; the memory is kept for the next parse
+    void release();
+
+    // Number of nodes in the tree
+    size_t size() const { return nodes.size() - dead; }
+
+private:
+    friend class CSTParser;
+
+    // Where the nodes of a top-level unit are: [root, end)
+    struct Unit {
+        NodeId root;
+        NodeId end;
+    };
+
+    vector<CSTNode> nodes;
+    vector<Unit> units;     // the Program node's children, so reparse() need not walk them
+    size_t dead;            // nodes of units reparse() has replaced
+
+    // Copies the units into a new array in source order, leaving out dead nodes
+    void compact();
 };
 /*
- * DEFINITION:  CSTParser::CSTParser(vector<Token> toks)
+ * DEFINITION:  CSTParser::CSTParser(string_view src)
+ *              CSTParser::CSTParser(SourceBuffer& src)
+ *              CSTParser::CSTParser(const vector<Token>& toks, string_view src)
+ *              CSTParser::CSTParser(const TokenStore& toks, string_view src)
  *
- * DESCRIPTION: Contructor for CSTParser class. Initializes the parser with a vector of tokes to parse.
+ * DESCRIPTION: Contructors for CSTParser class. The first lexes src on demand as the
+ *              parser reaches it, holding only a small window of tokens at a time.
+ *              The second does the same over a SourceBuffer that may still be being
+ *              read, reading more of it when the lines that have arrived are used up.
+ *              The others parse tokens that were already lexed from src.
  *
- * PARAMS:      toks: A vector of Token objects representing the tokenized input
+ * PARAMS:      src: The source buffer to parse (the tokens point into it)
+ *              toks: The tokenized input, as a vector or column-wise
  *
- * Pre:         toks: contains valid Token objects from the Tokenizer
- *              toks: should not be empty
+ * Pre:         src: must outlive the parser
+ *              toks: contains valid Token objects from the Tokenizer, and must
+ *                    outlive the parser (it is not copied)
  *
  * Post:        Parser is initialized with the token stream
- *              Current index is set to 0
+ *              The first token is current
  *
  * Returns: N/A (Contructor)
  *
  */
 class CSTParser {
 private:
-    vector<Token> tokens;
-    size_t current;
+    // A syntax error held back by a parser with deferErrors set
+    struct SyntaxError {
+        int line;
+        string message;
+
+        // Prints "Syntax error on line N: message" and exits
+        [[noreturn]] void report() const;
+    };
+
+    TokenStream tokens;
+    string_view source;
+    LineTable lines;
+    const SourceBuffer* streamed;   // the source when it is read as it is parsed, or null
+    bool deferErrors;   // throw SyntaxError rather than report and exit
+
+    /**
+     * @Description: Returns the spelling of a token from the source buffer.
+     * @Params:      tok: A token produced from this parser's source
+     * @return       string_view: The token text (no copy is made)
+     */
+    string_view text(const Token& tok) const;
+
+    /**
+     * @Description: Returns the source line a token starts on, for diagnostics.
+     * @Params:      tok: A token produced from this parser's source
+     * @return       int: The 1-based line, or 0 for the end-of-stream token
+     */
+    int lineOf(const Token& tok) const;
+
+    /**
+     * @Description: Returns what a literal token means, as decoded by the tokenizer.
+     * @Params:      tok: An INTEGER, DOUBLE_QUOTED_STRING or SINGLE_QUOTED_STRING token
+     * @return       const Literal&: Its pooled value (shared by every equal literal)
+     */
+    const Literal& literalOf(const Token& tok) const;
+
+    /**
+     * @Description: Returns a token's interned spelling. Most tokens were interned
+     *               by the tokenizer; the rest (e.g. stray bytes) are interned here.
+     * @Params:      tok: The token to look up
+     * @return       Symbol: The token's spelling
+     */
+    Symbol symbolOf(const Token& tok) const;
+
+    /**
+     * @Description: Reports a syntax error at a token and exits, or throws it as a
+     *               SyntaxError when deferErrors is set.
+     * @Params:      at: The token the error is found at (its line is reported)
+     *               message: What is wrong, e.g. "expected ';'"
+     */
+    [[noreturn]] void syntaxError(const Token& at, const string& message) const;
 
     /**
-     * @Description: Returns the current token without consuming it.
-     *               Automatically skips over whitespace and newline
-     *               tokens to get the next significant token.
-     * @Params:      NONE
+     * @Description: Returns the index of the current token in the tokens the
+     *               parser was constructed over (not raw input).
+     * @return       size_t: The index (the END_OF_FILE token's once the input is used up)
+     */
+    size_t position() const { return tokens.position(); }
+
+    /**
+     * @Description: Returns the current token (or the one after it) without consuming it.
+     *               The token stream holds significant tokens only, so
+     *               this is a plain window lookup.
+     * @Params:      ahead: How many tokens past the current one to look
+     *                      (at most TokenStream::LOOKAHEAD)
      * @Pre:         Parser has been initialized with a token stream
-     *               token vector is valid
-     * @return       TOken: The current token (after skipping whitespace/newlines
-     *               Returns TOken{END_OF_FILE, "", 0, 0} if at end of stream
+     * @return       const Token&: The requested token, in the stream's window (valid
+     *               until the parser moves on; copying a Token is a 12-byte move)
+     *               Returns an END_OF_FILE token if at end of stream
      */
-    Token peek();
+    const Token& peek(size_t ahead = 0) { return tokens.peek(ahead); }
 
     /**
      * @Description Returns the current token and moves to the next token in the stream.
-     *              Calls peek() to skip whitespace, then increments the current position.
+     *              Calls peek(), then increments the current position.
      * @Params      NONE
      * @Pre         -Parser has been initialized with a token stream
-     *              -Token vector is valid
-     * @Post        -Current index is incremented by 1
+     * @Post        -The stream moves on by one token
      *              -The current token is consumed
-     * @returns     -Token: The token that was current before advancing
+     * @returns     -const Token&: The token that was current before advancing
+     *              (valid until the parser moves on again)
      */
-    Token advance();
+    const Token& advance() { return tokens.advance(); }
 
     /**
      * @Description -Checks if the current token matches the specified type without consuming it.
@@ -87,24 +277,36 @@ private:
      *
      * @returns     -bool: true if current token matches type, false otherwise
      */
-    bool check(TokenType type);
+    bool check(TokenType type) { return peek().type == type; }
 
     /**
-     * @Description     -Checks if the current token's value matches the specified string
-     *                   without consuming the token.
-     *
-     * @param value     -The string value to match against
+     * @Description     -Checks if the current token can stand where a name is expected:
+     *                   an identifier, or a keyword (so misuse can be reported by name).
      *
      * @Pre             -Parser has been initialized with a token stream
-     *                  -Value is a valid string
      *
      * @Post            -No state changes
      *                  -No tokens are consumed
      *
-     * @returns         -bool: true if current token value matches the input string,
+     * @returns         -bool: true if current token is an IDENTIFIER or a keyword kind,
      *                  false otherwise
      */
-    bool match(const string& value);
+    bool checkName();
+
+    /**
+     * @Description     Expects the current token to be a name (see checkName). If it is,
+     *                  advances and returns the token. If not, prints an error message and exits
+     *
+     * @param errorMsg  Error message to display if expectation fails
+     *
+     * @Pre             Parser has been initialized w/ token stream
+     * @Post            If token is a name: current index advances, token is returned
+     *                  If not: error message
+     *
+     * @returns         const Token&: The name token (only if it matches)
+     *                  Exits if it doesnt match
+     */
+    const Token& expectName(const char* errorMsg);
 
     /**
      * @Description     Expects the current token to be of the specified type. If it matches,
@@ -118,46 +320,73 @@ private:
      * @Post            If token matches: current index advances, token is returned
      *                  If doesn't match: error message
      *
-     * @returns         Token: The expected token (only if it matches)
+     * @returns         const Token&: The expected token (only if it matches)
      *                  Exits if doesnt match
      */
-    Token expect(TokenType type, const string& errorMsg);
+    const Token& expect(TokenType type, const char* errorMsg);
+
+    ParseResult owned;      // holds the tree for parse() without a ParseResult
+    vector<CSTNode>* nodes; // where the parse in progress adds nodes
+    vector<NodeId> lastChild;   // per node while parsing, so appends need no sibling walk
+    uint32_t unitStart;         // where the top-level unit being parsed starts
+
+    // What a construct waiting on the statement or expression nested in it
+    // does once that is parsed. Nesting is kept on frames instead of the
+    // native stack, so how deep input may nest is bounded by heap only.
+    enum Resume : uint8_t {
+        IF_THEN,        // IfStmt: takes the then-statement, then maybe 'else'
+        IF_ELSE,        // IfStmt: takes the else-statement
+        LOOP_BODY,      // WhileStmt or ForStmt: takes the body
+        BLOCK_BODY,     // Block: takes a statement, then the next one or '}'
+        UNARY_OPERAND,  // UnaryOp: takes its operand
+        RIGHT_OPERAND,  // BinaryOp: takes its right operand
+        CALL_ARGUMENT,  // FunctionCall: takes an argument, then ',' or ')'
+        ARRAY_INDEX,    // ArrayAccess: takes the index, then ']'
+        PAREN_INNER     // ParenExpr: takes the inner expression, then ')'
+    };
+
+    struct Frame {
+        NodeId node;            // the waiting construct
+        Resume resume;
+        uint8_t minPrecedence;  // expression frames: operators the enclosing expression takes
+    };
+
+    vector<Frame> frames;   // innermost last; empty between parses
 
     /**
-     * @Description     Expects the current token to have the specified value. If it matches,
-     *                  advances and returns the token. If not, prints error
-     *
-     * @param value     The expected token value
-     * @param errorMsg  Error message to display
-     *
-     * @Pre             Parser has token stream
-     *                  Value is a valid string
-     *
-     * @Post            -If token value matches: current index advances, token is returned
-     *                  -If token value doesnt match: Error
-     *
-     * @returns         Token: The expected token if value matches
-     *                  Exits if !match
+     * @Description: Appends a node to the tree of the parse in progress.
+     * @Params:      value: The node's spelling or type name
+     *               off: Where it starts in the source, or NO_OFFSET (it is stored
+     *                    counting from unitStart)
+     * @return       NodeId: A new node with no children
+     */
+    NodeId makeNode(Symbol value, uint32_t off = NO_OFFSET);
+
+    /**
+     * @Description: Creates a leaf node holding a token's spelling and offset.
+     * @Params:      tok: The token to store
+     * @return       NodeId: A new node with no children
      */
-    Token expectValue(const string& value, const string& errorMsg);
+    NodeId leaf(const Token& tok);
 
     /**
      * @Description     Adds a child to a parent node in the CST. Uses left-child, right-sibling
      *                  representation. The child becomes either the first child or the last
-     *                  sibling of existing children.
+     *                  sibling of existing children. The last child of every node is kept
+     *                  while parsing, so this takes constant time.
      *
-     * @param parent    Pointer to the parent TreeNode
-     * @param child     Pointer to the child TreeNode to add
+     * @param parent    Index of the parent node
+     * @param child     Index of the child node to add
      *
-     * @Pre             Parent and child can be nullptr (function handles this case)
-     *                  If not nullptr, parent and child must point to valid TreeNode objects
+     * @Pre             Parent and child can be NO_NODE (function handles this case)
+     *                  child has not been added to a parent yet
      *
-     * @Post            if either parent or child is nullptr: no changes made
+     * @Post            if either parent or child is NO_NODE: no changes made
      *                  if parent has no children: child becomes leftCHild of parent
      *                  if parent has children: child is added as rightSibling of last child
      *                  Tree structure is modified to include the new child
      */
-    void addChild(TreeNode* parent, TreeNode* child);
+    void addChild(NodeId parent, NodeId child);
 
     /**
      * @Description     Entry point for parsing. Parses the entire program which consists
@@ -170,11 +399,25 @@ private:
      *                  Current index points to END_OF_FILE token
      *                  EXITS: if syntax error is encountered
      *
-     * @returns         TreeNode*: Pointer to root node labeled "Program" with all global
+     * @param units     Receives the nodes of each child of "Program", in order
+     *
+     * @returns         NodeId: Index of root node labeled "Program" with all global
      *                             declarations and functions as children
      *                  Exits program on syntax error
      */
-    TreeNode* parseProgram();
+    NodeId parseProgram(vector<ParseResult::Unit>& units);
+
+    /**
+     * @Description     Parses one function, procedure or global declaration: one step of
+     *                  parseProgram(). Its root holds where it starts, and its leaves
+     *                  their offsets from there.
+     *
+     * @Pre             Current token is not END_OF_FILE
+     *
+     * @returns         NodeId: Index of the routine's or "GlobalDecl" node
+     *                  Exits on syntax error (any other token starts no declaration)
+     */
+    NodeId parseTopLevel();
 
     /**
     * @Description     Parses a global variable declaration statement. Handles multiple variables
@@ -187,13 +430,13 @@ private:
     *                  Current index advances past the semicolon
     *                  Exits if syntax error
     *
-    * @returns         TreeNode* Pointer to node labeled "GlobalDecl" containing:
+    * @returns         NodeId: Index of node labeled "GlobalDecl" containing:
     *                            - Type token as first child
     *                            - Variable declarators and commas as subsequent children
     *                            - Semicolon as last child
     *                  Exits on syntax error
     */
-    TreeNode* parseGlobalDeclaration();
+    NodeId parseGlobalDeclaration();
 
     /**
      * @Description     Parses a function or procedure definition. Functions have a return type;
@@ -207,7 +450,7 @@ private:
      *                  Current index advances past the closing brace of the block
      *                  Exits if syntax error or reserved word used as function name
      *
-     * @returns         TreeNode*: Pointer to node labeled "function" or "procedure" containing:
+     * @returns         NodeId: Index of node labeled "function" or "procedure" containing:
      *                             - Keyword as first child
      *                             - Return type (functions only) as second child
      *                             - Function name as child
@@ -215,7 +458,7 @@ private:
      *                             - Block node
      *                  Exits on syntax error or reserved word violation
      */
-    TreeNode* parseFunctionOrProcedure();
+    NodeId parseFunctionOrProcedure();
 
     /**
      * @Description     Parses the parameter list of a function or procedure. Handles void
@@ -227,11 +470,11 @@ private:
      * @Post            Parameter list is parsed into a CST subtree
      *                  Current index advances past the last parameter
      *
-     * @returns         TreeNode*: Pointer to node labeled "Parameters" containing:
+     * @returns         NodeId: Index of node labeled "Parameters" containing:
      *                             - Single "void" child if no parameters
      *                             - OR parameter nodes and commas as children for parameter list
      */
-    TreeNode* parseParameters();
+    NodeId parseParameters();
 
     /**
      * @Description     Parses a single parameter declaration. Parameters can be scalar or array
@@ -245,17 +488,18 @@ private:
      *                  Current index advances past the parameter
      *                  Exits if syntax error or reserved word used as parameter name
      *
-     * @returns         TreeNode*: Pointer to node labeled "Parameter" containing:
+     * @returns         NodeId: Index of node labeled "Parameter" containing:
      *                             - Type as first child
      *                             - Parameter name as second child
      *                             - Optional: '[', optional size, ']' for array parameters
      *                  Exits on syntax error or reserved word violation
      */
-    TreeNode* parseParameter();
+    NodeId parseParameter();
 
     /**
      * @Description     Parses a code block enclosed in braces. Blocks contain local variable
-     *                  declarations followed by statements.
+     *                  declarations followed by statements. A routine body is parsed like
+     *                  any block statement, by parseStatement().
      *
      * @Pre             Current token is '{'
      *                  Block contains valid declarations and statements
@@ -264,14 +508,14 @@ private:
      *                  Current index advances past the closing '}'
      *                  Exits if syntax error (missing braces, invalid statements, etc.)
      *
-     * @returns         TreeNode*: Pointer to node labeled "Block" containing:
+     * @returns         NodeId: Index of node labeled "Block" containing:
      *                             - '{' as first child
      *                             - Declaration nodes (if any)
      *                             - Statement nodes
      *                             - '}' as last child
      *                  Exits on syntax error
      */
-    TreeNode* parseBlock();
+    NodeId parseBlock();
 
     /**
      * @Description     Parses a local variable declaration statement. Handles multiple variables
@@ -284,13 +528,13 @@ private:
      *                  Current index advances past the semicolon
      *                  Exits if syntax error
      *
-     * @returns         TreeNode*: Pointer to node labeled "Declaration" containing:
+     * @returns         NodeId: Index of node labeled "Declaration" containing:
      *                             - Type as first child
      *                             - Variable declarators and commas as subsequent children
      *                             - Semicolon as last child
      *                  Exits on syntax error
      */
-    TreeNode* parseDeclaration();
+    NodeId parseDeclaration();
 
     /**
      * @Description     Parses a single variable declarator (variable name with optional array size).
@@ -307,89 +551,101 @@ private:
      *                  - Array size is not a positive integer
      *                  - Array size is negative or zero
      *
-     * @returns         TreeNode*: Pointer to node labeled "VarDecl" containing:
+     * @returns         NodeId: Index of node labeled "VarDecl" containing:
      *                             - Variable name as first child
      *                             - Optional: '[', array size, ']' for array variables
      *                  Exits on syntax error or validation failure
      */
-    TreeNode* parseVariableDeclarator();
+    NodeId parseVariableDeclarator();
 
     /**
-     * @Description     Dispatcher function that determines the type of statement and calls the
-     *                  appropriate parsing function. Handles if, while, for, return, block,
-     *                  and expression statements.
+     * @Description     Parses a statement: if, while, for, return, block, or expression
+     *                  statement. Compound statements are opened by openIfStatement(),
+     *                  openWhileStatement(), openForStatement() and openBlock(), which
+     *                  push a frame for the construct; the statements nested in them are
+     *                  parsed by this same loop and handed to the frames as they finish,
+     *                  so no native-stack recursion grows with nesting depth.
      *
      * @Pre             Current token begins a valid statement
      *
      * @Post            Statement is parsed into a CST subtree
      *                  Current index advances past the statement
-     *                  Exits if token doesn't match any statement type
+     *                  Exits if a token doesn't match any statement type
      *
-     * @returns         TreeNode*: Pointer to appropriate statement node returned by:
-     *                             parseIfStatement(), parseWhileStatement(), parseForStatement(),
-     *                             parseReturnStatement(), parseBlock(), or parseExpressionStatement()
+     * @returns         NodeId: Index of the statement node ("IfStmt", "WhileStmt",
+     *                  "ForStmt", "ReturnStmt", "Block", "Assignment" or "ExprStmt")
      *                  Exits if unexpected token encountered
      */
-    TreeNode* parseStatement();
+    NodeId parseStatement();
 
     /**
-     * @Description     Parses an if statement with optional else clause. The condition must be
-     *                  enclosed in parentheses.
+     * @Description     Parses the head of an if statement, 'if' '(' condition ')', and
+     *                  pushes an IF_THEN frame; the rest (then statement, optional
+     *                  'else' and else statement) is added by parseStatement().
      *
      * @Pre             Current token is 'if'
-     *                  Valid condition expression and statements follow
      *
-     * @Post            If statement is parsed into a CST subtree
-     *                  Current index advances past the statement(s)
+     * @Post            Current index advances past the ')'
      *                  Exits if syntax error (missing parentheses, etc.)
      *
-     * @returns         TreeNode*: Pointer to node labeled "IfStmt" containing:
+     * @returns         void. The frame's node is labeled "IfStmt" and ends up containing:
      *                             - 'if' keyword
      *                             - '(', Condition expression, ')'
      *                             - Then statement
      *                             - Optional: 'else', else statement
-     *                  Exits on syntax error
      */
-    TreeNode* parseIfStatement();
+    void openIfStatement();
 
     /**
-     * @Description     Parses a while loop statement. The condition must be enclosed in parentheses.
+     * @Description     Parses the head of a while loop, 'while' '(' condition ')', and
+     *                  pushes a LOOP_BODY frame for the body.
      *
      * @Pre             Current token is 'while'
-     *                  Valid condition expression and statement follow
      *
-     * @Post            While statement is parsed into a CST subtree
-     *                  Current index advances past the loop body
+     * @Post            Current index advances past the ')'
      *                  Exits if syntax error (missing parentheses, etc.)
      *
-     * @returns         TreeNode*: Pointer to node labeled "WhileStmt" containing:
+     * @returns         void. The frame's node is labeled "WhileStmt" and ends up containing:
      *                             - 'while' keyword
      *                             - '(', Condition expression, ')'
      *                             - Loop body statement
-     *                  Exits on syntax error
      */
-    TreeNode* parseWhileStatement();
+    void openWhileStatement();
 
     /**
-     * @Description     Parses a for loop statement with initialization, condition, and update
-     *                  expressions.
+     * @Description     Parses the head of a for loop (initialization, condition and update)
+     *                  and pushes a LOOP_BODY frame for the body.
      *
      * @Pre             Current token is 'for'
-     *                  Valid initialization, condition, update, and body follow
      *
-     * @Post            For statement is parsed into a CST subtree
-     *                  Current index advances past the loop body
+     * @Post            Current index advances past the ')'
      *                  Exits if syntax error (missing parentheses, semicolons, etc.)
      *
-     * @returns         TreeNode*: Pointer to node labeled "ForStmt" containing:
+     * @returns         void. The frame's node is labeled "ForStmt" and ends up containing:
      *                             - 'for' keyword
      *                             - '(', Initialization assignment, ';'
      *                             - Condition expression, ';'
      *                             - Update assignment, ')'
      *                             - Loop body statement
-     *                  Exits on syntax error
      */
-    TreeNode* parseForStatement();
+    void openForStatement();
+
+    /**
+     * @Description     Parses the '{' and local declarations of a block and pushes a
+     *                  BLOCK_BODY frame for its statements and '}'.
+     *
+     * @Pre             Current token is '{'
+     *
+     * @Post            Current index advances past the declarations
+     *                  Exits on a malformed declaration
+     *
+     * @returns         void. The frame's node is labeled "Block" and ends up containing:
+     *                             - '{' as first child
+     *                             - Declaration nodes (if any)
+     *                             - Statement nodes
+     *                             - '}' as last child
+     */
+    void openBlock();
 
     /**
      * @Description     Parses a return statement with an expression.
@@ -401,13 +657,13 @@ private:
      *                  Current index advances past the semicolon
      *                  Exits if syntax error (missing semicolon, etc.)
      *
-     * @returns         TreeNode*: Pointer to node labeled "ReturnStmt" containing:
+     * @returns         NodeId: Index of node labeled "ReturnStmt" containing:
      *                             - 'return' keyword
      *                             - Return value expression
      *                             - ';'
      *                  Exits on syntax error
      */
-    TreeNode* parseReturnStatement();
+    NodeId parseReturnStatement();
 
     /**
      * @Description     Parses an expression statement, which can be either an assignment or a
@@ -420,12 +676,12 @@ private:
      *                  Current index advances past the semicolon
      *                  Exits if syntax error or unexpected token
      *
-     * @returns         TreeNode*: For assignment: Pointer to "Assignment" node with ';' appended
-     *                             For function call: Pointer to "ExprStmt" wrapper containing
+     * @returns         NodeId: For assignment: Index of "Assignment" node with ';' appended
+     *                             For function call: Index of "ExprStmt" wrapper containing
      *                             "FunctionCall" node and ';'
      *                  Exits on syntax error
      */
-    TreeNode* parseExpressionStatement();
+    NodeId parseExpressionStatement();
 
     /**
      * @Description     Parses an assignment statement. Supports both scalar and array element
@@ -438,7 +694,7 @@ private:
      *                  Current index advances past the expression
      *                  Exits if syntax error
      *
-     * @returns         TreeNode*: Pointer to node labeled "Assignment" containing:
+     * @returns         NodeId: Index of node labeled "Assignment" containing:
      *                             - Variable name
      *                             - Optional: '[', index expression, ']' for array assignment
      *                             - '='
@@ -446,187 +702,212 @@ private:
      *                  NOTE: Semicolon is NOT included in this node; caller consumes it
      *                  Exits on syntax error
      */
-    TreeNode* parseAssignment();
+    NodeId parseAssignment();
 
     /**
-     * @Description     Entry point for expression parsing. Delegates to parseLogicalOr() which
-     *                  begins the precedence climbing for operator precedence.
+     * @Description     Parses an expression by precedence climbing. An operand is parsed, then
+     *                  each following binary operator that binds at least as tightly as the
+     *                  enclosing level takes it as its left operand, with a right operand parsed
+     *                  at one level tighter, so every operator is left-associative. Levels,
+     *                  loosest first: || then && then == != then < > <= >= then + - then * / %
+     *                  Prefix operators, right operands, call arguments, array indices and
+     *                  parenthesized expressions wait on frames while what they contain is
+     *                  parsed, so any nesting depth takes constant native stack.
      *
      * @Pre             Current token begins a valid expression
      *
      * @Post            Expression is parsed into a CST subtree
      *                  Current index advances past the expression
+     *                  Exits if unexpected token encountered
      *
-     * @returns         TreeNode*: Pointer to expression subtree (result from parseLogicalOr())
+     * @returns         NodeId: Single operand if no binary operator present
+     *                             OR "BinaryOp" node with left operand, operator, and right operand
+     *                  An operand is a primary, or a "UnaryOp" node (!, -) with the operator
+     *                  and its operand as children
      */
-    TreeNode* parseExpression();
+    NodeId parseExpression();
 
     /**
-     * @Description     Parses logical OR expressions (||). Left-associative binary operator with
-     *                  lowest precedence.
+     * @Description     Parses a primary expression (highest precedence): a literal, an
+     *                  identifier, a function call, an array access, or a parenthesized
+     *                  expression. Uses lookahead to tell identifiers, calls and array
+     *                  accesses apart. Where an expression is nested inside (an argument,
+     *                  an index, the parenthesized expression) it pushes a frame and
+     *                  returns, and parseExpression() goes on with the inner expression.
      *
-     * @Pre             Current token begins a valid expression
-     *
-     * @Post            Logical OR expression is parsed into a CST subtree
-     *                  Current index advances past the expression
-     *
-     * @returns         TreeNode*: Single operand if no OR operator present
-     *                             OR "BinaryOp" node with left operand, "||", and right operand
-     */
-    TreeNode* parseLogicalOr();
-
-    /**
-     * @Description     Parses logical AND expressions (&&). Left-associative binary operator with
-     *                  precedence below OR, above equality.
+     * @param minPrecedence  The enclosing expression's level, kept in a pushed frame
      *
-     * @Pre             Current token begins a valid expression
+     * @Pre             Current token begins a valid primary expression
      *
-     * @Post            Logical AND expression is parsed into a CST subtree
-     *                  Current index advances past the expression
+     * @Post            Current index advances past the primary, or into it
+     *                  Exits if unexpected token encountered
      *
-     * @returns         TreeNode*: Single operand if no AND operator present
-     *                             OR "BinaryOp" node with left operand, "&&", and right operand
+     * @returns         NodeId: NO_NODE if a frame was pushed, or else one of:
+     *                             - Simple node with integer value (for INTEGER tokens)
+     *                             - Simple node with identifier name (for variable references)
+     *                             - "FunctionCall" node for a call without arguments
+     *                             - "CharLiteral" node with "'", content, "'"
+     *                             - "StringLiteral" node with "\"", content, "\""
+     *                  Frames are pushed for "FunctionCall" (arguments), "ArrayAccess"
+     *                  (name, '[', index, ']') and "ParenExpr" ('(', expression, ')')
      */
-    TreeNode* parseLogicalAnd();
+    NodeId openPrimary(uint8_t minPrecedence);
 
     /**
-     * @Description     Parses equality expressions (==, !=). Left-associative binary operators
-     *                  with precedence below AND, above relational.
+     * @Description     Parses a function call statement's call, with optional comma-separated
+     *                  arguments. (Calls inside expressions are parsed by openPrimary().)
      *
-     * @Pre             Current token begins a valid expression
+     * @Pre             Current token is an identifier (function name)
+     *                  Valid parameter list enclosed in parentheses follows
      *
-     * @Post            Equality expression is parsed into a CST subtree
-     *                  Current index advances past the expression
+     * @Post            Function call is parsed into a CST subtree
+     *                  Current index advances past the closing parenthesis
+     *                  Exits if syntax error
      *
-     * @returns         TreeNode*: Single operand if no equality operator present
-     *                             OR "BinaryOp" node with left operand, operator, and right operand
+     * @returns         NodeId: Index of node labeled "FunctionCall" containing:
+     *                             - Function name
+     *                             - '('
+     *                             - Argument expressions with commas (if any)
+     *                             - ')'
+     *                  Exits on syntax error
      */
-    TreeNode* parseEquality();
+    NodeId parseFunctionCall();
 
-    /**
-     * @Description     Parses relational expressions (<, >, <=, >=). Left-associative binary
-     *                  operators with precedence below equality, above additive.
-     *
-     * @Pre             Current token begins a valid expression
-     *
-     * @Post            Relational expression is parsed into a CST subtree
-     *                  Current index advances past the expression
-     *
-     * @returns         TreeNode*: Single operand if no relational operator present
-     *                             OR "BinaryOp" node with left operand, operator, and right operand
-     */
-    TreeNode* parseRelational();
+    // Parsers that start partway into a source, at token from of toks: for
+    // parseParallel() and reparse()
+    CSTParser(const TokenStore& toks, string_view src, size_t from);
+    CSTParser(const IncrementalTokenizer& toks, string_view src, size_t from);
+
+public:
+    explicit CSTParser(string_view src);
+    explicit CSTParser(SourceBuffer& src);
+    CSTParser(const vector<Token>& toks, string_view src);
+    CSTParser(const TokenStore& toks, string_view src);
 
     /**
-     * @Description     Parses additive expressions (+, -). Left-associative binary operators
-     *                  with precedence below relational, above multiplicative.
+     * @Description     Public interface for parsing. Entry point that calls parseProgram() to
+     *                  construct the complete CST.
      *
-     * @Pre             Current token begins a valid expression
+     * @Pre             Parser has been initialized with a valid token stream
      *
-     * @Post            Additive expression is parsed into a CST subtree
-     *                  Current index advances past the expression
+     * @Post            Entire program is parsed into a CST
+     *                  Exits if any syntax errors are encountered
      *
-     * @returns         TreeNode*: Single operand if no additive operator present
-     *                             OR "BinaryOp" node with left operand, operator, and right operand
+     * @returns         TreeRef: The root of the CST (labeled "Program"),
+     *                  owned by the parser
+     *                  Exits program on syntax error
      */
-    TreeNode* parseAdditive();
+    TreeRef parse();
 
     /**
-     * @Description     Parses multiplicative expressions (*, /, %). Left-associative binary
-     *                  operators with precedence below additive, above unary.
+     * @Description     Same as parse(), with the tree allocated in result instead of
+     *                  the parser, so it can outlive the parser and be freed in one step.
      *
-     * @Pre             Current token begins a valid expression
+     * @param result    Receives the tree; a tree it already holds is released first
      *
-     * @Post            Multiplicative expression is parsed into a CST subtree
-     *                  Current index advances past the expression
+     * @Post            result.root is the root of the CST
      *
-     * @returns         TreeNode*: Single operand if no multiplicative operator present
-     *                             OR "BinaryOp" node with left operand, operator, and right operand
+     * @returns         TreeRef: result.root
+     *                  Exits program on syntax error
      */
-    TreeNode* parseMultiplicative();
+    TreeRef parse(ParseResult& result);
 
     /**
-     * @Description     Parses unary expressions (!, -). Right-associative unary operators with
-     *                  precedence below multiplicative, above primary.
+     * @Description     Parses the next function, procedure or global declaration only,
+     *                  so a caller that lowers each unit as it comes need not hold the
+     *                  CST of the whole program. Called until it returns null, it reads
+     *                  the input parse() reads and reports the same errors.
      *
-     * @Pre             Current token begins a valid expression
+     * @param result    Receives the unit's subtree; a tree it already holds is released
+     *                  first, so one result serves every unit. It holds no "Program"
+     *                  node, and is not a tree reparse() can take.
      *
-     * @Post            Unary expression is parsed into a CST subtree
-     *                  Current index advances past the expression
+     * @Pre             parse() has not been called on this parser
      *
-     * @returns         TreeNode*: Single operand if no unary operator present
-     *                             OR "UnaryOp" node with operator and operand as children
+     * @returns         TreeRef: result.root, the unit's "function", "procedure" or
+     *                  "GlobalDecl" node; null once the input is used up
+     *                  Exits program on syntax error
      */
-    TreeNode* parseUnary();
+    TreeRef parseUnit(ParseResult& result);
 
     /**
-     * @Description     Parses primary expressions (highest precedence). Includes literals,
-     *                  identifiers, function calls, array access, and parenthesized expressions.
-     *                  Uses lookahead to distinguish between identifiers, function calls, and
-     *                  array access.
+     * @Description     Same tree and errors as CSTParser(src).parse(result), with the
+     *                  top-level routines and global declarations parsed on separate
+     *                  threads. src is lexed up front into a TokenStore (by
+     *                  Tokenizer::tryTokenizeParallel), and TokenStore::routineStarts()
+     *                  cuts the tokens into runs of whole top-level units of about equal
+     *                  size, one per thread. Each run is parsed into a node array of its
+     *                  own, and the arrays are joined in source order under "Program", so
+     *                  the nodes sit exactly where parse() puts them. Inputs that
+     *                  parallelRuns() gives one run are parsed serially.
      *
-     * @Pre             Current token begins a valid primary expression
+     * @param src       The source buffer to parse; it must outlive the tree
+     * @param result    Receives the tree; a tree it already holds is released first
+     * @param threads   How many threads to use (0 means one per hardware thread)
      *
-     * @Post            Primary expression is parsed into a CST subtree
-     *                  Current index advances past the expression
-     *                  Exits if unexpected token encountered
+     * @Post            result.root is the root of the CST
+     *                  The error reported is the first one in source order, the one
+     *                  parse() reports
      *
-     * @returns         TreeNode*: One of the following:
-     *                             - Simple node with integer value (for INTEGER tokens)
-     *                             - Simple node with identifier name (for variable references)
-     *                             - "FunctionCall" node (for function calls)
-     *                             - "ArrayAccess" node with name, '[', index, ']'
-     *                             - "CharLiteral" node with "'", content, "'"
-     *                             - "StringLiteral" node with "\"", content, "\""
-     *                             - "ParenExpr" node with '(', expression, ')'
-     *                  Exits on unexpected token
+     * @returns         TreeRef: result.root
+     *                  Exits program on a lexical or syntax error
      */
-    TreeNode* parsePrimary();
+    static TreeRef parseParallel(string_view src, ParseResult& result, unsigned threads = 0);
 
     /**
-     * @Description     Parses a function call with optional comma-separated arguments.
+     * @Description     How many runs parseParallel() cuts a source into: one per thread,
+     *                  but none shorter than a size below which the threads cost more
+     *                  than they save.
      *
-     * @Pre             Current token is an identifier (function name)
-     *                  Valid parameter list enclosed in parentheses follows
+     * @param bytes     The size of the source
+     * @param threads   As for parseParallel()
      *
-     * @Post            Function call is parsed into a CST subtree
-     *                  Current index advances past the closing parenthesis
-     *                  Exits if syntax error
-     *
-     * @returns         TreeNode*: Pointer to node labeled "FunctionCall" containing:
-     *                             - Function name
-     *                             - '('
-     *                             - Argument expressions with commas (if any)
-     *                             - ')'
-     *                  Exits on syntax error
+     * @returns         unsigned: At least 1; 1 means the source is parsed serially
      */
-    TreeNode* parseFunctionCall();
-
-public:
-    CSTParser(vector<Token> toks);
+    static unsigned parallelRuns(size_t bytes, unsigned threads = 0);
 
     /**
-     * @Description     Public interface for parsing. Entry point that calls parseProgram() to
-     *                  construct the complete CST.
+     * @Description     Edits a source and brings its tree up to date, reparsing only the
+     *                  top-level units the edit can have changed. The tokenizer
+     *                  re-lexes about the edit (see IncrementalTokenizer), and parsing
+     *                  restarts at the first token after the last routine or global
+     *                  declaration that ends before the edit. It stops as soon as it is
+     *                  between two units at the (shifted) start of an old unit past the
+     *                  edit: from there on the old units are what a full parse would
+     *                  make. Their nodes are kept as they are: offsets count from the
+     *                  start of a unit, so only the start of each is shifted by the
+     *                  change in length. A one-line change inside a routine reparses
+     *                  that routine, plus one step for every later unit. A lexical or
+     *                  syntax error is found by parsing the source in full.
      *
-     * @Pre             Parser has been initialized with a valid token stream
+     * @param source    The source before the edit; it is edited here
+     * @param result    The tree parse(), parseParallel() or reparse() made from
+     *                  source.text() before the edit (a result holding no tree is
+     *                  parsed in full)
+     * @param offset    Where the edit starts
+     * @param length    How many bytes at offset are replaced
+     * @param replacement What replaces them
      *
-     * @Post            Entire program is parsed into a CST
-     *                  Exits if any syntax errors are encountered
+     * @Pre             offset + length is at most the size of the text
      *
-     * @returns         TreeNode*: Pointer to the root of the CST (labeled "Program")
-     *                  Exits program on syntax error
+     * @Post            result holds the tree parse() would make from source.text(),
+     *                  though its units' nodes may sit elsewhere in the array
+     *
+     * @returns         TreeRef: result.root
+     *                  Exits program on a lexical or syntax error, reporting the one
+     *                  parse() would report
      */
-    TreeNode* parse();
+    static TreeRef reparse(IncrementalTokenizer& source, ParseResult& result, size_t offset, size_t length,
+                           string_view replacement);
 
     /**
-     * @Description     Recursively prints the CST in a tree format with indentation. Static
+     * @Description     Prints the CST in a tree format with indentation. Static
      *                  utility function that can be called without a parser instance.
      *
-     * @param node      Pointer to the current node to print
+     * @param node      The current node to print
      * @param depth     Current depth in the tree (for indentation, default 0)
      *
-     * @Pre             node can be nullptr (handled gracefully)
+     * @Pre             node can be null (handled gracefully)
      *                  depth should be >= 0
      *
      * @Post            Tree structure is printed to stdout
@@ -636,32 +917,35 @@ public:
      * @returns         void (no return value)
      *                  Output is written to stdout
      */
-    static void printTree(TreeNode* node, int depth = 0);
+    static void printTree(TreeRef node, int depth = 0);
 
     /**
      * @Description     Prints tokens in a formatted layout that represents the CST structure.
-     *                  Filters out whitespace and END_OF_FILE tokens, handles string literals
-     *                  specially, and maintains proper line formatting.
+     *                  Line breaks are taken from the trivia side table, handles string
+     *                  literals specially, and maintains proper line formatting.
      *
-     * @param tokens    Vector of Token objects to print
+     * @param tokens    Vector of significant Token objects to print
+     * @param trivia    The WHITESPACE/NEWLINE tokens filled in by Tokenizer::tokenize
+     * @param source    The source buffer the tokens point into
      * @param out       Output file stream to write to
      *
      * @Pre             tokens is a valid vector of Token objects
      *                  out is an open, writable output stream
      *
      * @Post            Tokens are written to the output stream in formatted layout
-     *                  Whitespace and END_OF_FILE tokens are filtered out
+     *                  END_OF_FILE is not printed
      *                  String literals are formatted with content separated from quotes
      *                  Each source line is preserved as a separate output line
      *
      * @returns         void (no return value)
      *                  Output is written to the provided ofstream
      */
-    static void printCST(vector<Token>& tokens, ofstream& out);
+    static void printCST(vector<Token>& tokens, const vector<Token>& trivia, string_view source, ofstream& out);
 
     /**
      * @Description     Checks if a given word is a reserved keyword in the language. Static
      *                  utility function that can be called without a parser instance.
+     *                  Tokens need no lookup: keywords already have their own TokenType.
      *
      * @param word      The string to check
      *
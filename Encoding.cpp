@@ -0,0 +1,123 @@
+#include "Encoding.h"
+#include "LineTable.h"
+#include <iostream>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Length of the well-formed sequence starting at p[i], or 0 if there is none
+size_t sequenceLength(const unsigned char* p, size_t i, size_t n) {
+    const unsigned char lead = p[i];
+    size_t length;
+    unsigned char low = 0x80, high = 0xBF;     // allowed range of the second byte
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) {
+            low = 0xA0;         // overlong below U+0800
+        } else if (lead == 0xED) {
+            high = 0x9F;        // surrogates
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) {
+            low = 0x90;         // overlong below U+10000
+        } else if (lead == 0xF4) {
+            high = 0x8F;        // above U+10FFFF
+        }
+    } else {
+        return 0;
+    }
+    if (n - i < length || p[i + 1] < low || p[i + 1] > high) {
+        return 0;
+    }
+    for (size_t k = 2; k < length; k++) {
+        if (p[i + k] < 0x80 || p[i + k] > 0xBF) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+}
+
+EncodingReport Encoding::check(string_view input) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t n = input.size();
+    EncodingReport report{0, {}};
+
+    size_t i = 0;
+    while (i < n) {
+#if defined(__SSE2__)
+        // The top bit of every byte: zero means all ASCII. Four blocks are
+        // tested per branch, then the block with the first set bit is found.
+        for (; n - i >= 64; i += 64) {
+            const __m128i* q = reinterpret_cast<const __m128i*>(p + i);
+            __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(q), _mm_loadu_si128(q + 1)),
+                                       _mm_or_si128(_mm_loadu_si128(q + 2), _mm_loadu_si128(q + 3)));
+            if (_mm_movemask_epi8(any)) {
+                break;
+            }
+        }
+        for (; n - i >= 16; i += 16) {
+            unsigned mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+            if (mask) {
+                i += __builtin_ctz(mask);
+                break;
+            }
+        }
+#endif
+        while (i < n && p[i] < 0x80) {
+            i++;
+        }
+        if (i == n) {
+            break;
+        }
+
+        size_t length = sequenceLength(p, i, n);
+        if (length == 0) {
+            if (report.invalid.size() < MAX_LISTED) {
+                report.invalid.push_back(i);
+            }
+            report.invalidCount++;
+            length = 1;
+        }
+        i += length;
+    }
+    return report;
+}
+
+void Encoding::validate(string_view input, size_t from) {
+    EncodingReport report = check(input.substr(from));
+    if (report.invalidCount == 0) {
+        return;
+    }
+    for (size_t& offset : report.invalid) {
+        offset += from;
+    }
+
+    LineTable lines(input);
+    cerr << "Error on line " << lines.line(static_cast<uint32_t>(report.invalid[0]))
+         << ": source is not valid UTF-8 (" << report.invalidCount << " invalid byte"
+         << (report.invalidCount == 1 ? "" : "s");
+    if (report.invalidCount > 1) {
+        cerr << ", on lines";
+        int last = 0;
+        for (size_t offset : report.invalid) {
+            int line = lines.line(static_cast<uint32_t>(offset));
+            if (line != last) {
+                cerr << (last ? ", " : " ") << line;
+                last = line;
+            }
+        }
+        if (report.invalidCount > report.invalid.size()) {
+            cerr << ", ...";
+        }
+    }
+    cerr << ")" << endl;
+    exit(1);
+}
@@ -0,0 +1,33 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// What one sweep over a source buffer found
+struct EncodingReport {
+    size_t invalidCount;        // bytes that are not part of a well-formed UTF-8 sequence
+    vector<size_t> invalid;     // offsets of the first MAX_LISTED of them
+};
+
+// Checks that a source is ASCII or well-formed UTF-8 before any of the
+// byte-at-a-time state machines see it. Well-formed is RFC 3629: no overlong
+// forms, no surrogates and nothing above U+10FFFF.
+class Encoding {
+public:
+    static const size_t MAX_LISTED = 8;
+
+    // Runs of ASCII are skipped 64 bytes per branch; only the bytes of
+    // multi-byte sequences are decoded one at a time.
+    static EncodingReport check(string_view input);
+
+    // Reports every invalid byte from offset from on in one error and exits;
+    // returns only if that part of the input is well-formed. Lines are
+    // counted from the start of input.
+    static void validate(string_view input, size_t from = 0);
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "IncrementalTokenizer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Stop offsets handed to the lexer at a time, and the tokens it may lex
+    // before the next batch is fetched: enough for a line or two, so a normal
+    // edit takes one round, without listing every later token up front.
+    const size_t STOP_BATCH = 64;
+    const size_t TOKEN_BATCH = 4096;
+}
+
+IncrementalTokenizer::IncrementalTokenizer(string source)
+    : buffer(move(source)), textGapStart(0), textGapEnd(0), tokenGapStart(0), tokenGapEnd(0),
+      status(Tokenizer::LEX_END_OF_FILE), errorFromEnd(0) {
+    textGapStart = textGapEnd = buffer.size();
+    tokens.reserve(buffer.size() / 4 + 1);
+    Interner::Cache symbols;
+    Tokenizer::LexResult r = Tokenizer::lex(buffer, 0, vector<size_t>(), SIZE_MAX, symbols, tokens, nullptr);
+    status = r.status;
+    errorFromEnd = buffer.size() - min(r.end, buffer.size());
+    tokenGapStart = tokenGapEnd = tokens.size();
+}
+
+string_view IncrementalTokenizer::text() {
+    moveTextGap(textLength(), 0);
+    return string_view(buffer.data(), textGapStart);
+}
+
+string_view IncrementalTokenizer::textFrom(size_t offset) {
+    moveTextGap(offset, 0);
+    return string_view(buffer.data() + (textGapEnd - textGapStart), textLength());
+}
+
+vector<Token> IncrementalTokenizer::all() const {
+    vector<Token> result;
+    result.reserve(size());
+    for (size_t k = 0; k < size(); k++) {
+        result.push_back((*this)[k]);
+    }
+    return result;
+}
+
+void IncrementalTokenizer::reportError() {
+    string_view input = text();
+    Tokenizer::reportError(status, input, input.size() - errorFromEnd);
+}
+
+void IncrementalTokenizer::moveTextGap(size_t offset, size_t width) {
+    if (textGapEnd - textGapStart < width) {
+        size_t tail = buffer.size() - textGapEnd;
+        size_t grown = max(width, textLength() / 2 + 4096);
+        buffer.resize(textGapStart + grown + tail);
+        memmove(&buffer[textGapStart + grown], &buffer[textGapEnd], tail);
+        textGapEnd = textGapStart + grown;
+    }
+    if (offset < textGapStart) {
+        size_t count = textGapStart - offset;
+        memmove(&buffer[textGapEnd - count], &buffer[offset], count);
+        textGapStart -= count;
+        textGapEnd -= count;
+    } else if (offset > textGapStart) {
+        size_t count = offset - textGapStart;
+        memmove(&buffer[textGapStart], &buffer[textGapEnd], count);
+        textGapStart += count;
+        textGapEnd += count;
+    }
+}
+
+void IncrementalTokenizer::moveTokenGap(size_t k, size_t width) {
+    if (tokenGapEnd - tokenGapStart < width) {
+        size_t tail = tokens.size() - tokenGapEnd;
+        size_t grown = max(width, size() / 2 + 64);
+        tokens.resize(tokenGapStart + grown + tail, Token(END_OF_FILE, 0, 0));
+        move_backward(tokens.begin() + tokenGapEnd, tokens.begin() + tokenGapEnd + tail, tokens.end());
+        tokenGapEnd = tokenGapStart + grown;
+    }
+    // Tokens crossing the gap switch between counting from the start and
+    // counting from the end of the text
+    uint32_t length = static_cast<uint32_t>(textLength());
+    while (tokenGapStart > k) {
+        Token tok = tokens[--tokenGapStart];
+        tok.offset = length - tok.offset;
+        tokens[--tokenGapEnd] = tok;
+    }
+    while (tokenGapStart < k) {
+        Token tok = tokens[tokenGapEnd++];
+        tok.offset = length - tok.offset;
+        tokens[tokenGapStart++] = tok;
+    }
+}
+
+void IncrementalTokenizer::edit(size_t offset, size_t length, string_view replacement) {
+    // A token is settled by the bytes up to and including the one after it,
+    // so the first token that can change is the first whose end reaches the
+    // edit. The lexer is in its start state at the end of the one before.
+    size_t count = size();
+    size_t first = 0;
+    for (size_t hi = count; first < hi;) {
+        size_t mid = first + (hi - first) / 2;
+        Token tok = (*this)[mid];
+        if (tok.offset + tok.length < offset) {
+            first = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t begin = 0;
+    if (first > 0) {
+        Token tok = (*this)[first - 1];
+        begin = tok.offset + tok.length;
+    }
+
+    // Old tokens starting past the edit are where the new lexing may rejoin them
+    size_t next = first;
+    for (size_t hi = count; next < hi;) {
+        size_t mid = next + (hi - next) / 2;
+        if (offsetAt(mid) < offset + length) {
+            next = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // With the token gap before the first token that can change, every token
+    // after it keeps its place relative to the end of the text, which the
+    // edit does not move. The text is edited at its gap, which is then left
+    // at begin so that everything the lexer reads is contiguous.
+    moveTokenGap(first, 0);
+    moveTextGap(offset, replacement.size());
+    textGapEnd += length;
+    memcpy(&buffer[textGapStart], replacement.data(), replacement.size());
+    textGapStart += replacement.size();
+    moveTextGap(begin, 0);
+    string_view rest(buffer.data() + textGapEnd, buffer.size() - textGapEnd);
+
+    // The lexer sees the text from begin on, so its offsets are relative to begin
+    vector<Token> fresh;
+    Interner::Cache symbols;
+    vector<size_t> stops;
+    for (size_t at = 0;;) {
+        stops.clear();
+        for (size_t k = next; k < count && stops.size() < STOP_BATCH; k++) {
+            stops.push_back(offsetAt(k) - begin);
+        }
+        Tokenizer::LexResult r = Tokenizer::lex(rest, at, stops, fresh.size() + TOKEN_BATCH, symbols, fresh, nullptr);
+        if (r.status != Tokenizer::LEX_STOPPED) {
+            // Lexed to the end of the text: no old token survives
+            status = r.status;
+            errorFromEnd = rest.size() - min(r.end, rest.size());
+            next = count;
+            break;
+        }
+        while (next < count && offsetAt(next) - begin < r.end) {
+            next++;
+        }
+        if (next < count && offsetAt(next) - begin == r.end) {
+            // Both lexings are between tokens here, before the same bytes
+            break;
+        }
+        at = r.end;
+    }
+
+    tokenGapEnd += next - first;
+    moveTokenGap(first, fresh.size());
+    for (Token tok : fresh) {
+        tok.offset += static_cast<uint32_t>(begin);
+        tokens[tokenGapStart++] = tok;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef INCREMENTALTOKENIZER_H
+#define INCREMENTALTOKENIZER_H
+
+#include "Tokenizer.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Owns a source text and its significant tokens, and keeps them in step as
+// the text is edited. An edit re-lexes from the end of the last token it
+// cannot have affected, and stops as soon as the lexer reaches the (shifted)
+// start of an old token past the edit between two tokens: from there on the
+// old tokens are what a full re-lex would produce. Typing in one line
+// therefore re-lexes about that line, though an edit that opens a comment or
+// string re-lexes as far as the comment or string now runs.
+//
+// The text and the tokens are both gap buffers, with the gap left where the
+// last edit was. Tokens after the gap record their offset from the end of
+// the text rather than the start, so an edit shifts every later token
+// without touching them. Only what the gaps move across (the distance
+// between successive edits) is copied.
+//
+// Unlike Tokenizer::tokenize(), a lexical error does not end the run: the
+// tokens stop where the error is, hasError() says so, and later edits can
+// repair it.
+class IncrementalTokenizer
+{
+public:
+    explicit IncrementalTokenizer(string source);
+
+    // Replaces length bytes at offset with replacement and brings the tokens
+    // up to date. Requires offset + length <= size of the text.
+    void edit(size_t offset, size_t length, string_view replacement);
+
+    // The whole text; closes the text gap, which moves the bytes after it
+    string_view text();
+
+    // The text as seen from offset on: the bytes of the view at offset and
+    // past it are the text's, those before it must not be read. Moves the
+    // text gap to offset, which after an edit copies about the bytes between
+    // offset and the edit only.
+    string_view textFrom(size_t offset);
+
+    size_t size() const { return tokens.size() - (tokenGapEnd - tokenGapStart); }
+
+    // Token k, with its offset in the current text
+    Token operator[](size_t k) const
+    {
+        if (k < tokenGapStart) {
+            return tokens[k];
+        }
+        Token tok = tokens[k + (tokenGapEnd - tokenGapStart)];
+        tok.offset = static_cast<uint32_t>(textLength()) - tok.offset;
+        return tok;
+    }
+
+    // All tokens, as Tokenizer::tokenize() would return them
+    vector<Token> all() const;
+
+    bool hasError() const { return status >= Tokenizer::LEX_UNTERMINATED_COMMENT; }
+
+    // Prints the error the way Tokenizer::tokenize() does, and exits
+    [[noreturn]] void reportError();
+
+private:
+    string buffer;
+    size_t textGapStart;
+    size_t textGapEnd;
+    vector<Token> tokens;
+    size_t tokenGapStart;
+    size_t tokenGapEnd;
+    Tokenizer::LexStatus status;
+    size_t errorFromEnd;        // where the error is, counted back from the end of the text
+
+    size_t textLength() const { return buffer.size() - (textGapEnd - textGapStart); }
+
+    uint32_t offsetAt(size_t k) const { return (*this)[k].offset; }
+
+    // Puts the text gap before byte offset, at least width bytes wide
+    void moveTextGap(size_t offset, size_t width);
+
+    // Puts the token gap before token k, at least width tokens wide
+    void moveTokenGap(size_t k, size_t width);
+};
+
+#endif
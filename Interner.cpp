@@ -0,0 +1,216 @@
+#include "Interner.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+// Indexed by WellKnownSymbol
+const string_view wellKnownSpellings[] = {
+    "",
+
+    "int", "char", "void", "bool", "function", "procedure", "if", "else",
+    "while", "for", "return", "printf", "TRUE", "FALSE",
+
+    "(", ")", "[", "]", "{", "}",
+    ";", ",", "=", "+", "-", "*", "/",
+    "%", "^", "<", ">", "<=", ">=", "&&",
+    "||", "!", "==", "!=",
+    "\"", "'",
+
+    "Program", "GlobalDecl", "Parameters", "Parameter", "Block", "Declaration",
+    "VarDecl", "IfStmt", "WhileStmt", "ForStmt", "ReturnStmt", "Assignment",
+    "ExprStmt", "FunctionCall", "BinaryOp", "UnaryOp", "ParenExpr",
+    "ArrayAccess", "CharLiteral", "StringLiteral",
+
+    "Routine", "Decl", "Var", "Assign", "If", "While",
+    "For", "Return", "Call", "Printf", "Bin", "Un",
+    "Id", "Int", "Str", "Char", "Bool", "ArrAt",
+    "Else",
+
+    "datatype", "parameter", "NOT APPLICABLE"
+};
+
+static_assert(sizeof(wellKnownSpellings) / sizeof(wellKnownSpellings[0]) == WELL_KNOWN_SYMBOL_COUNT,
+              "wellKnownSpellings must list every WellKnownSymbol");
+
+// Spellings are spread over independently locked shards by hash, so threads
+// interning different names rarely wait on each other.
+const size_t SHARD_COUNT = 64;
+
+// Symbol -> spelling is a two-level table. Segments are allocated on demand
+// and never move, so readers need no lock.
+const int SEGMENT_BITS = 16;
+const size_t SEGMENT_SIZE = size_t(1) << SEGMENT_BITS;
+const size_t MAX_SEGMENTS = size_t(1) << (32 - SEGMENT_BITS);
+
+const size_t ARENA_BLOCK = 64 * 1024;
+
+struct SpellingHash {
+    size_t operator()(string_view text) const {
+        return Interner::hash(text);
+    }
+};
+
+struct Shard {
+    mutex lock;
+    unordered_map<string_view, Symbol, SpellingHash> symbols;
+    vector<unique_ptr<char[]> > blocks;
+    char* next = nullptr;
+    size_t left = 0;
+
+    // Copies text into this shard's arena
+    string_view store(string_view text) {
+        if (text.size() > left) {
+            size_t size = max(ARENA_BLOCK, text.size());
+            blocks.emplace_back(new char[size]);
+            next = blocks.back().get();
+            left = size;
+        }
+        memcpy(next, text.data(), text.size());
+        string_view stored(next, text.size());
+        next += text.size();
+        left -= text.size();
+        return stored;
+    }
+};
+
+struct Table {
+    Shard shards[SHARD_COUNT];
+    atomic<Symbol> nextSymbol{0};
+    atomic<string_view*> segments[MAX_SEGMENTS] = {};
+
+    Table() {
+        addWellKnown();
+    }
+
+    void addWellKnown() {
+        for (string_view text : wellKnownSpellings) {
+            add(shards[Interner::hash(text) % SHARD_COUNT], text);
+        }
+    }
+
+    // Back to the state after construction. The first segment is kept, as
+    // the well-known symbols are entered into it again.
+    void clear() {
+        for (Shard& shard : shards) {
+            unordered_map<string_view, Symbol, SpellingHash>().swap(shard.symbols);
+            shard.blocks.clear();
+            shard.next = nullptr;
+            shard.left = 0;
+        }
+        for (size_t k = 1; k < MAX_SEGMENTS; k++) {
+            delete[] segments[k].exchange(nullptr, memory_order_acq_rel);
+        }
+        nextSymbol.store(0, memory_order_relaxed);
+        addWellKnown();
+    }
+
+    // Called with the shard locked
+    Symbol add(Shard& shard, string_view text) {
+        string_view stored = shard.store(text);
+        Symbol symbol = nextSymbol.fetch_add(1, memory_order_relaxed);
+
+        atomic<string_view*>& segment = segments[symbol >> SEGMENT_BITS];
+        string_view* entries = segment.load(memory_order_acquire);
+        if (!entries) {
+            string_view* fresh = new string_view[SEGMENT_SIZE];
+            if (segment.compare_exchange_strong(entries, fresh, memory_order_acq_rel)) {
+                entries = fresh;
+            } else {
+                delete[] fresh;
+            }
+        }
+        entries[symbol & (SEGMENT_SIZE - 1)] = stored;
+
+        shard.symbols.emplace(stored, symbol);
+        return symbol;
+    }
+};
+
+Table& table() {
+    static Table instance;
+    return instance;
+}
+
+}
+
+uint32_t Interner::hash(string_view text) {
+    const char* p = text.data();
+    size_t n = text.size();
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+    while (n >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (h ^ word) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+        p += 8;
+        n -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, n);
+    h = (h ^ tail) * 0x94D049BB133111EBull;
+    h ^= h >> 29;
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+Symbol Interner::intern(string_view text) {
+    Table& t = table();
+    Shard& shard = t.shards[hash(text) % SHARD_COUNT];
+    lock_guard<mutex> guard(shard.lock);
+    auto found = shard.symbols.find(text);
+    if (found != shard.symbols.end()) {
+        return found->second;
+    }
+    return t.add(shard, text);
+}
+
+string_view Interner::spelling(Symbol symbol) {
+    return table().segments[symbol >> SEGMENT_BITS].load(memory_order_acquire)[symbol & (SEGMENT_SIZE - 1)];
+}
+
+void Interner::reset() {
+    table().clear();
+}
+
+Interner::Cache::Cache() : slots(256), used(0) {}
+
+Symbol Interner::Cache::intern(string_view text) {
+    uint32_t h = hash(text);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (!slot.text) {
+            Symbol symbol = Interner::intern(text);
+            slot = {text.data(), static_cast<uint32_t>(text.size()), h, symbol};
+            if (++used * 2 > slots.size()) {
+                grow();
+            }
+            return symbol;
+        }
+        if (slot.hash == h && slot.length == text.size() && memcmp(slot.text, text.data(), text.size()) == 0) {
+            return slot.symbol;
+        }
+    }
+}
+
+void Interner::Cache::grow() {
+    vector<Slot> old(slots.size() * 2);
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (!slot.text) {
+            continue;
+        }
+        size_t i = slot.hash & mask;
+        while (slots[i].text) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
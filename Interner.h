@@ -0,0 +1,95 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// A Symbol names one distinct spelling for the whole run: equal spellings get
+// equal symbols, so later stages store and compare 32-bit IDs, not strings.
+typedef uint32_t Symbol;
+
+// Spellings every stage needs are interned up front in this order, so each
+// has a fixed ID that can be compared against (or switched on) directly. The
+// keywords come first, in the same order as their TokenTypes.
+enum WellKnownSymbol : Symbol {
+    SYM_NONE,               // ""
+
+    SYM_INT, SYM_CHAR, SYM_VOID, SYM_BOOL, SYM_FUNCTION, SYM_PROCEDURE, SYM_IF, SYM_ELSE,
+    SYM_WHILE, SYM_FOR, SYM_RETURN, SYM_PRINTF, SYM_TRUE, SYM_FALSE,
+
+    // Punctuation and operators
+    SYM_L_PAREN, SYM_R_PAREN, SYM_L_BRACKET, SYM_R_BRACKET, SYM_L_BRACE, SYM_R_BRACE,
+    SYM_SEMICOLON, SYM_COMMA, SYM_ASSIGN, SYM_PLUS, SYM_MINUS, SYM_ASTERISK, SYM_DIVIDE,
+    SYM_MODULO, SYM_CARET, SYM_LT, SYM_GT, SYM_LT_EQUAL, SYM_GT_EQUAL, SYM_BOOLEAN_AND,
+    SYM_BOOLEAN_OR, SYM_BOOLEAN_NOT, SYM_BOOLEAN_EQUAL, SYM_BOOLEAN_NOT_EQUAL,
+    SYM_DOUBLE_QUOTE, SYM_SINGLE_QUOTE,
+
+    // CST node kinds
+    SYM_PROGRAM, SYM_GLOBAL_DECL, SYM_PARAMETERS, SYM_PARAMETER, SYM_BLOCK, SYM_DECLARATION,
+    SYM_VAR_DECL, SYM_IF_STMT, SYM_WHILE_STMT, SYM_FOR_STMT, SYM_RETURN_STMT, SYM_ASSIGNMENT,
+    SYM_EXPR_STMT, SYM_FUNCTION_CALL, SYM_BINARY_OP, SYM_UNARY_OP, SYM_PAREN_EXPR,
+    SYM_ARRAY_ACCESS, SYM_CHAR_LITERAL, SYM_STRING_LITERAL,
+
+    // AST node kinds
+    SYM_AST_ROUTINE, SYM_AST_DECL, SYM_AST_VAR, SYM_AST_ASSIGN, SYM_AST_IF, SYM_AST_WHILE,
+    SYM_AST_FOR, SYM_AST_RETURN, SYM_AST_CALL, SYM_AST_PRINTF, SYM_AST_BIN, SYM_AST_UN,
+    SYM_AST_ID, SYM_AST_INT, SYM_AST_STR, SYM_AST_CHAR, SYM_AST_BOOL, SYM_AST_ARR_AT,
+    SYM_AST_ELSE,
+
+    // Symbol table identifier types
+    SYM_DATATYPE, SYM_PARAMETER_TYPE, SYM_NOT_APPLICABLE,
+
+    WELL_KNOWN_SYMBOL_COUNT
+};
+
+// Process-wide and safe to call from any thread. Spellings are copied into
+// storage owned by the interner and live until reset() or the process exits,
+// so the views returned by spelling() stay valid until then.
+//
+// Only the well-known symbols have fixed values. Any other spelling gets the
+// next free value when it is first interned, so its value depends on the
+// order threads reach it (Tokenizer::tokenizeParallel lexes on several) and
+// may differ between runs over the same input. Symbols compare equal exactly
+// when their spellings do; output must be ordered by source position or
+// spelling, never by symbol value.
+class Interner {
+public:
+    static Symbol intern(string_view text);
+    static string_view spelling(Symbol symbol);
+
+    // Forgets every spelling but the well-known ones and frees their storage,
+    // for a process that compiles one source after another; reset the
+    // LiteralPool with it. Requires that no other thread uses the interner
+    // meanwhile, and that no Symbol, spelling view or Cache from before is
+    // used after.
+    static void reset();
+
+    // A per-thread front for intern(): remembers the spellings it has seen in
+    // a private table, so only the first sighting of each one takes a lock.
+    // The cache keeps views of the looked-up text, which must outlive it.
+    class Cache {
+    public:
+        Cache();
+        Symbol intern(string_view text);
+
+    private:
+        struct Slot {
+            const char* text;
+            uint32_t length;
+            uint32_t hash;
+            Symbol symbol;
+        };
+        vector<Slot> slots;
+        size_t used;
+
+        void grow();
+    };
+
+    static uint32_t hash(string_view text);
+};
+
+#endif
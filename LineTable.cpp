@@ -0,0 +1,51 @@
+#include "LineTable.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+LineTable::LineTable(string_view source) : source(source) {}
+
+// Newlines are found 16 bytes per compare; the set bits of each match mask
+// give the line starts in order
+void LineTable::build() const {
+    const char* p = source.data();
+    const size_t n = source.size();
+    starts.push_back(0);
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; n - i >= 16; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        for (unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)); mask; mask &= mask - 1) {
+            starts.push_back(static_cast<uint32_t>(i + __builtin_ctz(mask) + 1));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == '\n') {
+            starts.push_back(static_cast<uint32_t>(i + 1));
+        }
+    }
+}
+
+int LineTable::line(uint32_t offset) const {
+    if (offset > source.size()) {
+        return 0;
+    }
+    call_once(built, [this]() { build(); });
+    return static_cast<int>(upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+}
+
+int LineTable::column(uint32_t offset) const {
+    int ln = line(offset);
+    if (ln == 0) {
+        return 0;
+    }
+    return static_cast<int>(offset - starts[ln - 1]) + 1;
+}
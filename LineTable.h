@@ -0,0 +1,43 @@
+#ifndef LINETABLE_H
+#define LINETABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Tokens and tree nodes record where they start as a byte offset into the
+// source. Nodes that stand for no single token (node kinds such as Block)
+// carry NO_OFFSET.
+const uint32_t NO_OFFSET = UINT32_MAX;
+
+// Maps byte offsets in a source buffer to 1-based lines and columns. The
+// table of line starts is only built the first time it is asked, so a run
+// that prints no diagnostics never scans the source for newlines. Lookups are
+// a binary search and are safe from any thread.
+class LineTable {
+public:
+    explicit LineTable(string_view source);
+
+    LineTable(const LineTable&) = delete;
+    LineTable& operator=(const LineTable&) = delete;
+
+    // The line holding the byte at offset (the end of the source counts as
+    // being on the last line). Offsets past the end, such as NO_OFFSET, give 0.
+    int line(uint32_t offset) const;
+
+    // The byte column of offset within its line, or 0 where line() is 0
+    int column(uint32_t offset) const;
+
+private:
+    string_view source;
+    mutable vector<uint32_t> starts;
+    mutable once_flag built;
+
+    void build() const;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "LiteralPool.h"
+#include <atomic>
+#include <climits>
+
+using namespace std;
+
+namespace {
+
+// Symbol -> Literal, laid out like the Interner's spelling table: segments
+// are allocated on demand and never move, so lookups take no lock.
+const int SEGMENT_BITS = 16;
+const size_t SEGMENT_SIZE = size_t(1) << SEGMENT_BITS;
+const size_t MAX_SEGMENTS = size_t(1) << (32 - SEGMENT_BITS);
+
+atomic<atomic<const Literal*>*> segments[MAX_SEGMENTS];
+
+atomic<const Literal*>& slot(Symbol symbol) {
+    atomic<atomic<const Literal*>*>& segment = segments[symbol >> SEGMENT_BITS];
+    atomic<const Literal*>* entries = segment.load(memory_order_acquire);
+    if (!entries) {
+        atomic<const Literal*>* fresh = new atomic<const Literal*>[SEGMENT_SIZE]();
+        if (segment.compare_exchange_strong(entries, fresh, memory_order_acq_rel)) {
+            entries = fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    return entries[symbol & (SEGMENT_SIZE - 1)];
+}
+
+// Publishes literal for symbol unless another thread got there first, and
+// returns whichever was published
+const Literal& publish(atomic<const Literal*>& entry, Literal* literal) {
+    const Literal* expected = nullptr;
+    if (entry.compare_exchange_strong(expected, literal, memory_order_acq_rel)) {
+        return *literal;
+    }
+    delete literal;
+    return *expected;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decodes the escapes the tokenizer accepts: \xH or \xHH gives that byte,
+// the usual C letters give their control characters, and a backslash before
+// anything else stands for that byte.
+string decode(string_view raw) {
+    string bytes;
+    bytes.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        char c = raw[i];
+        if (c != '\\' || i + 1 == raw.size()) {
+            bytes += c;
+            continue;
+        }
+        c = raw[++i];
+        switch (c) {
+            case 'n': bytes += '\n'; break;
+            case 't': bytes += '\t'; break;
+            case 'r': bytes += '\r'; break;
+            case '0': bytes += '\0'; break;
+            case 'a': bytes += '\a'; break;
+            case 'b': bytes += '\b'; break;
+            case 'f': bytes += '\f'; break;
+            case 'v': bytes += '\v'; break;
+            case 'x': {
+                int value = 0;
+                int digits = 0;
+                while (digits < 2 && i + 1 < raw.size() && hexValue(raw[i + 1]) >= 0) {
+                    value = value * 16 + hexValue(raw[++i]);
+                    digits++;
+                }
+                bytes += digits ? static_cast<char>(value) : 'x';
+                break;
+            }
+            default: bytes += c; break;
+        }
+    }
+    return bytes;
+}
+
+}
+
+const Literal& LiteralPool::integer(Symbol symbol, string_view digits) {
+    atomic<const Literal*>& entry = slot(symbol);
+    if (const Literal* known = entry.load(memory_order_acquire)) {
+        return *known;
+    }
+
+    Literal* literal = new Literal{Literal::INTEGER_LITERAL, false, 0, SYM_NONE, string()};
+    bool negative = !digits.empty() && digits[0] == '-';
+    // Accumulated as a negative number so INT_MIN itself fits
+    long long value = 0;
+    for (size_t i = negative ? 1 : 0; i < digits.size() && !literal->overflow; i++) {
+        value = value * 10 - (digits[i] - '0');
+        literal->overflow = value < INT_MIN;
+    }
+    if (!negative) {
+        value = -value;
+        literal->overflow = literal->overflow || value > INT_MAX;
+    }
+    literal->value = literal->overflow ? 0 : static_cast<int>(value);
+    return publish(entry, literal);
+}
+
+const Literal& LiteralPool::text(Symbol symbol, Literal::Kind kind, string_view text) {
+    atomic<const Literal*>& entry = slot(symbol);
+    if (const Literal* known = entry.load(memory_order_acquire)) {
+        return *known;
+    }
+
+    string_view raw = text.substr(1, text.size() - 2);
+    Literal* literal = new Literal{kind, false, 0, Interner::intern(raw), decode(raw)};
+    if (kind == Literal::CHAR_LITERAL && literal->bytes.size() == 1) {
+        literal->value = static_cast<unsigned char>(literal->bytes[0]);
+    }
+    return publish(entry, literal);
+}
+
+const Literal* LiteralPool::find(Symbol symbol) {
+    atomic<const Literal*>* entries = segments[symbol >> SEGMENT_BITS].load(memory_order_acquire);
+    return entries ? entries[symbol & (SEGMENT_SIZE - 1)].load(memory_order_acquire) : nullptr;
+}
+
+void LiteralPool::reset() {
+    for (atomic<atomic<const Literal*>*>& segment : segments) {
+        atomic<const Literal*>* entries = segment.exchange(nullptr, memory_order_acq_rel);
+        if (!entries) {
+            continue;
+        }
+        for (size_t k = 0; k < SEGMENT_SIZE; k++) {
+            delete entries[k].load(memory_order_relaxed);
+        }
+        delete[] entries;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef LITERALPOOL_H
+#define LITERALPOOL_H
+
+#include "Interner.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// What a literal token means, worked out once by the tokenizer.
+struct Literal {
+    enum Kind : uint8_t {
+        INTEGER_LITERAL,
+        STRING_LITERAL,
+        CHAR_LITERAL
+    };
+
+    Kind kind;
+    bool overflow;      // an integer outside the range of int
+    int value;          // integer value; for a one-byte char literal, that byte
+    Symbol content;     // string or char spelling between the quotes, escapes untouched
+    string bytes;       // string or char contents with escapes decoded
+};
+
+// Literals are keyed by the Symbol of their token's spelling (quotes
+// included), so every distinct literal is decoded once per run however
+// often it appears. Like the Interner it is process-wide and safe to use
+// from any thread, and its entries live until reset() or the process exits.
+class LiteralPool {
+public:
+    // The meaning of the integer spelled digits (an optional '-' and decimal
+    // digits), whose interned spelling is symbol
+    static const Literal& integer(Symbol symbol, string_view digits);
+
+    // The meaning of the string or char literal spelled text, quotes
+    // included, whose interned spelling is symbol
+    static const Literal& text(Symbol symbol, Literal::Kind kind, string_view text);
+
+    // The literal whose spelling is symbol, or nullptr if it spells none
+    static const Literal* find(Symbol symbol);
+
+    // Frees every literal, for a process that compiles one source after
+    // another (reset the Interner with it, since symbols key the pool).
+    // Requires that no other thread uses the pool meanwhile and that no
+    // Literal from before is used after.
+    static void reset();
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "SourceBuffer.h"
+#include "Encoding.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+SourceBuffer::SourceBuffer() : bytes(""), length(0), mapping(nullptr), mappingSize(0), reading(-1), checked(0) {}
+
+SourceBuffer::~SourceBuffer() {
+    release();
+}
+
+void SourceBuffer::reportTooLarge(const string& path) {
+    cerr << "ERROR: " << path << " is larger than " << MAX_SIZE << " bytes" << endl;
+    exit(1);
+}
+
+void SourceBuffer::release() {
+#if !defined(_WIN32)
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+    if (reading >= 0 && reading != STDIN_FILENO) {
+        close(reading);
+    }
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+    reading = -1;
+    checked = 0;
+    owned.clear();
+    bytes = "";
+    length = 0;
+}
+
+#if !defined(_WIN32)
+
+bool SourceBuffer::open(const string& path) {
+    release();
+
+    int fd = (path == "-") ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    name = path;
+
+    struct stat info;
+    bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    if (regular && static_cast<uintmax_t>(info.st_size) > MAX_SIZE) {
+        reportTooLarge(path);
+    }
+    if (regular && info.st_size > 0) {
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+            mapping = mapped;
+            mappingSize = info.st_size;
+            bytes = static_cast<const char*>(mapped);
+            length = info.st_size;
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+            return true;
+        }
+    }
+
+    // Not mappable (pipe, terminal, empty file): read as it is needed, into
+    // address space reserved for the largest source, which is only backed by
+    // memory as it is written. Without the reservation, read it all now.
+    void* reserved = mmap(nullptr, MAX_SIZE + 1, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved != MAP_FAILED) {
+        mapping = reserved;
+        mappingSize = MAX_SIZE + 1;
+        bytes = static_cast<const char*>(reserved);
+        reading = fd;
+        return true;
+    }
+    char chunk[1 << 16];
+    ssize_t got;
+    while ((got = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (got < 0) {
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+            release();
+            return false;
+        }
+        owned.append(chunk, got);
+        if (owned.size() > MAX_SIZE) {
+            reportTooLarge(path);
+        }
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    bytes = owned.data();
+    length = owned.size();
+    return true;
+}
+
+bool SourceBuffer::readMore() {
+    if (reading < 0) {
+        return false;
+    }
+    char* end = static_cast<char*>(mapping) + length;
+    ssize_t got = read(reading, end, min<size_t>(1 << 16, mappingSize - length));
+    if (got < 0) {
+        cerr << "ERROR: " << name << " could not be read" << endl;
+        exit(1);
+    }
+    if (got == 0) {
+        finishReading();
+        return false;
+    }
+    length += got;
+    if (length > MAX_SIZE) {
+        reportTooLarge(name);
+    }
+
+    // Only whole lines are checked, so no UTF-8 sequence is cut in two
+    size_t lastLine = view().substr(checked).rfind('\n');
+    if (lastLine != string_view::npos) {
+        Encoding::validate(view().substr(0, checked + lastLine + 1), checked);
+        checked += lastLine + 1;
+    }
+    return true;
+}
+
+void SourceBuffer::finishReading() {
+    Encoding::validate(view(), checked);
+    checked = length;
+    if (reading != STDIN_FILENO) {
+        close(reading);
+    }
+    reading = -1;
+}
+
+#else
+
+bool SourceBuffer::open(const string& path) {
+    release();
+
+    FILE* file = (path == "-") ? stdin : fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    char chunk[1 << 16];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) != 0) {
+        owned.append(chunk, got);
+        if (owned.size() > MAX_SIZE) {
+            reportTooLarge(path);
+        }
+    }
+    bool ok = !ferror(file);
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (!ok) {
+        release();
+        return false;
+    }
+    bytes = owned.data();
+    length = owned.size();
+    return true;
+}
+
+bool SourceBuffer::readMore() {
+    return false;
+}
+
+void SourceBuffer::finishReading() {}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SOURCEBUFFER_H
+#define SOURCEBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Read-only view of a whole input file. Regular files are memory-mapped so
+// the source is never copied. Pipes, stdin ("-") and anything mmap refuses
+// are read as they are consumed: view() holds what has arrived so far, and
+// readMore() adds to it. The bytes read stay where they are while it grows,
+// so tokens and views into them remain valid.
+class SourceBuffer {
+public:
+    SourceBuffer();
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    // Tokens and tree nodes record 32-bit offsets, with UINT32_MAX standing
+    // for none, so a source must be shorter than that.
+    static const size_t MAX_SIZE = UINT32_MAX - 1;
+
+    // Returns false if the file cannot be opened. Exits with an error if it
+    // is larger than MAX_SIZE.
+    bool open(const string& path);
+
+    // Whether the whole file is in view(); a mapped file always is
+    bool complete() const { return reading < 0; }
+
+    // Reads the next block of an incomplete source, checking the encoding of
+    // each line as it is completed (see Encoding::validate()). Returns false,
+    // with the source complete, once the input is used up. Exits with an
+    // error if the file cannot be read, is not valid UTF-8, or grows past
+    // MAX_SIZE.
+    bool readMore();
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    string_view view() const { return string_view(bytes, length); }
+
+private:
+    const char* bytes;
+    size_t length;
+    void* mapping;
+    size_t mappingSize;
+    string owned;
+    string name;
+    int reading;        // the descriptor still being read, or -1
+    size_t checked;     // bytes whose encoding has been checked
+
+    void release();
+    void finishReading();
+
+    [[noreturn]] static void reportTooLarge(const string& path);
+};
+
+#endif
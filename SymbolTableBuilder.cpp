@@ -1,13 +1,13 @@
 #include "SymbolTableBuilder.h"
 #include <iostream>
 
-SymbolTableEntry::SymbolTableEntry(std::string name, std::string idType, std::string dtype, bool array, int arrSize, int sc, int ln)
+SymbolTableEntry::SymbolTableEntry(Symbol name, Symbol idType, Symbol dtype, bool array, int arrSize, int sc, uint32_t off)
     : identifierName(name), identifierType(idType), dataType(dtype),
-      isArray(array), arraySize(arrSize), scope(sc), line(ln), next(nullptr) {}
+      isArray(array), arraySize(arrSize), scope(sc), offset(off), next(nullptr) {}
 
-SymbolTable::SymbolTable() : head(nullptr), tail(nullptr) {}
+SymbolTable::SymbolTable(const LineTable& lines) : head(nullptr), tail(nullptr), lines(lines) {}
 
-SymbolTableEntry* SymbolTable::findInScope(std::string name, int scope) {
+SymbolTableEntry* SymbolTable::findInScope(Symbol name, int scope) {
     SymbolTableEntry* curr = head;
     while (curr) {
         if (curr->identifierName == name && curr->scope == scope) {
@@ -18,8 +18,8 @@ SymbolTableEntry* SymbolTable::findInScope(std::string name, int scope) {
     return nullptr;
 }
 
-void SymbolTable::insert(std::string name, std::string idType, std::string dtype, bool isArray, int arrSize, int scope, int line) {
-    SymbolTableEntry* entry = new SymbolTableEntry(name, idType, dtype, isArray, arrSize, scope, line);
+void SymbolTable::insert(Symbol name, Symbol idType, Symbol dtype, bool isArray, int arrSize, int scope, uint32_t offset) {
+    SymbolTableEntry* entry = new SymbolTableEntry(name, idType, dtype, isArray, arrSize, scope, offset);
 
     if (!head) {
         head = tail = entry;
@@ -32,10 +32,10 @@ void SymbolTable::insert(std::string name, std::string idType, std::string dtype
 void SymbolTable::print() {
     SymbolTableEntry* curr = head;
     while (curr) {
-        if (curr->identifierType != "parameter") {
-            std::cout << "      IDENTIFIER_NAME: " << curr->identifierName << std::endl;
-            std::cout << "      IDENTIFIER_TYPE: " << curr->identifierType << std::endl;
-            std::cout << "             DATATYPE: " << curr->dataType << std::endl;
+        if (curr->identifierType != SYM_PARAMETER_TYPE) {
+            std::cout << "      IDENTIFIER_NAME: " << Interner::spelling(curr->identifierName) << std::endl;
+            std::cout << "      IDENTIFIER_TYPE: " << Interner::spelling(curr->identifierType) << std::endl;
+            std::cout << "             DATATYPE: " << Interner::spelling(curr->dataType) << std::endl;
             std::cout << "    DATATYPE_IS_ARRAY: ";
             if (curr->isArray) {
                 std::cout << "yes";
@@ -51,217 +51,206 @@ void SymbolTable::print() {
     }
 }
 
-void SymbolTableBuilder::buildSymbolTable(TreeNode* node, SymbolTable& table, int& currentScope,
-                                          std::vector<ParameterList>& parameterLists) {
-    if (!node) return;
+int SymbolTableBuilder::arraySizeOf(Symbol size, uint32_t offset, Symbol name, const SymbolTable& table) {
+    const Literal* literal = LiteralPool::find(size);
+    if (!literal || literal->kind != Literal::INTEGER_LITERAL || literal->overflow) {
+        std::cerr << "Error on line " << table.lines.line(offset) << ": array size of \"" << Interner::spelling(name)
+                  << "\" is not a valid integer" << std::endl;
+        exit(1);
+    }
+    return literal->value;
+}
 
-    if (node->value == "function" && node->leftChild && node->leftChild->value == "function") {
-        TreeNode* kw = node->leftChild;
-        TreeNode* typeNode = kw->rightSibling;
-        TreeNode* nameNode;
-        if (typeNode) {
-            nameNode = typeNode->rightSibling;
+void SymbolTableBuilder::declareVariable(Symbol name, Symbol type, bool isArray, int size, int scope,
+                                         uint32_t offset, SymbolTable& table) {
+    SymbolTableEntry* existingVar = table.findInScope(name, scope);
+    if (existingVar && (existingVar->identifierType == SYM_DATATYPE || existingVar->identifierType == SYM_PARAMETER_TYPE)) {
+        if (scope == 0) {
+            std::cerr << "Error on line " << table.lines.line(offset) << ": variable \"" << Interner::spelling(name)
+                 << "\" is already defined globally" << std::endl;
         } else {
-            nameNode = nullptr;
+            std::cerr << "Error on line " << table.lines.line(offset) << ": variable \"" << Interner::spelling(name)
+                 << "\" is already defined locally" << std::endl;
         }
-        if (!kw || !typeNode || !nameNode) {
-            return;
-        }
-
-        std::string funcName = nameNode->value;
-        std::string funcType = typeNode->value;
-
-        currentScope++;
-        int funcScope = currentScope;
-
-        table.insert(funcName, "function", funcType, false, 0, funcScope, nameNode->line);
+        exit(1);
+    }
 
-        TreeNode* walker = nameNode->rightSibling;
-        while (walker && walker->value != "Parameters") {
-            walker = walker->rightSibling;
+    if (scope > 0) {
+        SymbolTableEntry* globalVar = table.findInScope(name, 0);
+        if (globalVar && (globalVar->identifierType == SYM_DATATYPE || globalVar->identifierType == SYM_PARAMETER_TYPE)) {
+            std::cerr << "Error on line " << table.lines.line(offset) << ": variable \"" << Interner::spelling(name)
+                 << "\" is already defined globally" << std::endl;
+            exit(1);
         }
+    }
 
-        ParameterList paramList;
-        paramList.functionName = funcName;
-        if (walker) {
-            TreeNode* param = walker->leftChild;
-            while (param) {
-                if (param->value == "Parameter") {
-                    std::string type = param->leftChild->value;
-                    TreeNode* paramNameNode = param->leftChild->rightSibling;
-                    std::string paramName = paramNameNode->value;
-                    int paramLine = paramNameNode->line;
-                    bool isArray = false;
-                    int arraySize = 0;
+    table.insert(name, SYM_DATATYPE, type, isArray, size, scope, offset);
+}
 
-                    TreeNode* bracketNode = param->leftChild->rightSibling->rightSibling;
-                    if (bracketNode && bracketNode->value == "[") {
-                        isArray = true;
-                        TreeNode* sizeNode = bracketNode->rightSibling;
-                        if (sizeNode && sizeNode->value != "]") {
-                            arraySize = std::stoi(sizeNode->value);
-                        }
-                    }
+namespace {
 
-                    paramList.params.push_back({paramName, type, funcScope, isArray, arraySize});
-                    table.insert(paramName, "parameter", type, isArray, arraySize, funcScope, paramLine);
-                }
-                param = param->rightSibling;
-            }
-        }
-        parameterLists.push_back(paramList);
+// Interior CST nodes have no offset; tokens, even ones spelled like a
+// node label, do
+bool isStructural(TreeRef node) {
+    return node->offset == NO_OFFSET;
+}
 
-        TreeNode* block = walker;
-        while (block && block->value != "Block") {
-            block = block->rightSibling;
-        }
-        if (block) {
-            buildSymbolTable(block, table, funcScope, parameterLists);
+// Records each VarDecl of a GlobalDecl or Declaration
+void collectVariables(TreeRef decl, Declared::Kind kind, std::vector<Declared>& declarations) {
+    Symbol type = decl->leftChild->value;
+    for (TreeRef var = decl->leftChild->rightSibling; var; var = var->rightSibling) {
+        if (!isStructural(var)) {
+            continue;   // ',' or ';'
         }
-
-        if (node->rightSibling) {
-            buildSymbolTable(node->rightSibling, table, currentScope, parameterLists);
+        TreeRef name = var->leftChild;
+        TreeRef bracket = name->rightSibling;
+        Symbol size = SYM_NONE;
+        uint32_t sizeOffset = NO_OFFSET;
+        if (bracket) {
+            size = bracket->rightSibling->value;
+            sizeOffset = bracket->rightSibling->offset;
         }
-        return;
+        declarations.push_back({kind, static_cast<bool>(bracket), name->value, name->offset, type, size, sizeOffset});
     }
+}
 
-    if (node->value == "procedure" && node->leftChild && node->leftChild->value == "procedure") {
-        TreeNode* kw = node->leftChild;
-        TreeNode* nameNode = kw->rightSibling;
-        if (!nameNode) {
-            return;
+// Records a function or procedure and its parameters; returns its body
+TreeRef collectRoutine(TreeRef routine, std::vector<Declared>& declarations) {
+    bool isFunction = routine->value == SYM_FUNCTION;
+    TreeRef kw = routine->leftChild;
+    TreeRef typeNode = isFunction ? kw->rightSibling : nullptr;
+    TreeRef nameNode = isFunction ? typeNode->rightSibling : kw->rightSibling;
+    declarations.push_back({isFunction ? Declared::FUNCTION : Declared::PROCEDURE, false, nameNode->value,
+                            nameNode->offset, isFunction ? typeNode->value : SYM_NONE, SYM_NONE, NO_OFFSET});
+
+    // name ( Parameters ) Block
+    TreeRef params = nameNode->rightSibling->rightSibling;
+    for (TreeRef param = params->leftChild; param; param = param->rightSibling) {
+        if (!isStructural(param)) {
+            continue;   // 'void' or ','
         }
-        std::string procName = nameNode->value;
-
-        currentScope++;
-        int procScope = currentScope;
-
-        table.insert(procName, "procedure", "NOT APPLICABLE", false, 0, procScope, nameNode->line);
-
-        TreeNode* walker = nameNode->rightSibling;
-        while (walker && walker->value != "Parameters") {
-            walker = walker->rightSibling;
+        TreeRef type = param->leftChild;
+        TreeRef name = type->rightSibling;
+        TreeRef bracket = name->rightSibling;
+        Symbol size = SYM_NONE;
+        uint32_t sizeOffset = NO_OFFSET;
+        // type name [ '[' [size] ']' ]
+        if (bracket && bracket->rightSibling->rightSibling) {
+            size = bracket->rightSibling->value;
+            sizeOffset = bracket->rightSibling->offset;
         }
+        declarations.push_back({Declared::PARAMETER, static_cast<bool>(bracket), name->value, name->offset,
+                                type->value, size, sizeOffset});
+    }
 
-        ParameterList paramList;
-        paramList.functionName = procName;
-        if (walker) {
-            TreeNode* param = walker->leftChild;
-            while (param) {
-                if (param->value == "Parameter") {
-                    std::string type = param->leftChild->value;
-                    TreeNode* paramNameNode = param->leftChild->rightSibling;
-                    std::string paramName = paramNameNode->value;
-                    int paramLine = paramNameNode->line;
-                    bool isArray = false;
-                    int arraySize = 0;
+    return params->rightSibling->rightSibling;
+}
 
-                    TreeNode* bracketNode = param->leftChild->rightSibling->rightSibling;
-                    if (bracketNode && bracketNode->value == "[") {
-                        isArray = true;
-                        TreeNode* sizeNode = bracketNode->rightSibling;
-                        if (sizeNode && sizeNode->value != "]") {
-                            arraySize = std::stoi(sizeNode->value);
-                        }
-                    }
+}
 
-                    paramList.params.push_back({paramName, type, procScope, isArray, arraySize});
-                    table.insert(paramName, "parameter", type, isArray, arraySize, procScope, paramLine);
-                }
-                param = param->rightSibling;
-            }
+void SymbolTableBuilder::collectDeclarations(TreeRef node, std::vector<Declared>& declarations) {
+    // Records what n declares and returns the first of its children to visit
+    auto visit = [&](TreeRef n) -> TreeRef {
+        if (!isStructural(n)) {
+            return nullptr;
         }
-
-        if (!paramList.params.empty()) {
-            parameterLists.push_back(paramList);
+        if (n->value == SYM_FUNCTION || n->value == SYM_PROCEDURE) {
+            return collectRoutine(n, declarations);
         }
-
-        TreeNode* block = walker;
-        while (block && block->value != "Block") {
-            block = block->rightSibling;
+        if (n->value == SYM_GLOBAL_DECL) {
+            collectVariables(n, Declared::GLOBAL, declarations);
+        } else if (n->value == SYM_DECLARATION) {
+            collectVariables(n, Declared::LOCAL, declarations);
+        } else if (n->value == SYM_PROGRAM || n->value == SYM_BLOCK || n->value == SYM_IF_STMT ||
+                   n->value == SYM_WHILE_STMT || n->value == SYM_FOR_STMT) {
+            return n->leftChild;
         }
-        if (block) {
-            buildSymbolTable(block, table, procScope, parameterLists);
+        return nullptr;
+    };
+
+    // Preorder: each entry is the next node of a child list, whose siblings
+    // wait beneath the children of the node taken off
+    std::vector<TreeRef> pending;
+    if (node) {
+        if (TreeRef first = visit(node)) {
+            pending.push_back(first);
         }
-
-        if (node->rightSibling) {
-            buildSymbolTable(node->rightSibling, table, currentScope, parameterLists);
+    }
+    while (!pending.empty()) {
+        TreeRef n = pending.back();
+        pending.pop_back();
+        if (n->rightSibling) {
+            pending.push_back(n->rightSibling);
+        }
+        if (TreeRef first = visit(n)) {
+            pending.push_back(first);
         }
-        return;
     }
+}
 
-    if (node->value == "Declaration" || node->value == "GlobalDecl") {
-        std::string type = node->leftChild->value;
-        int typeLine = node->leftChild->line;
-        TreeNode* var = node->leftChild->rightSibling;
-        while (var) {
-            if (var->value == "VarDecl") {
-                std::string name = var->leftChild->value;
-                int varLine = var->leftChild->line;
+void SymbolTableBuilder::buildSymbolTable(TreeRef node, SymbolTable& table, int& currentScope,
+                                          std::vector<ParameterList>& parameterLists) {
+    std::vector<Declared> declarations;
+    collectDeclarations(node, declarations);
+    buildSymbolTable(declarations, table, currentScope, parameterLists);
+}
 
-                int lineToReport;
-                if (varLine > 0) {
-                    lineToReport = varLine;
-                } else {
-                    lineToReport = typeLine;
-                }
+void SymbolTableBuilder::buildSymbolTable(const std::vector<Declared>& declarations, SymbolTable& table,
+                                          int& currentScope, std::vector<ParameterList>& parameterLists) {
+    for (size_t i = 0; i < declarations.size(); i++) {
+        const Declared& decl = declarations[i];
 
-                bool isArray = var->leftChild->rightSibling && var->leftChild->rightSibling->value == "[";
-                int size;
-                if (isArray) {
-                    size = std::stoi(var->leftChild->rightSibling->rightSibling->value);
-                } else {
-                    size = 0;
-                }
+        if (decl.kind == Declared::FUNCTION || decl.kind == Declared::PROCEDURE) {
+            bool isFunction = decl.kind == Declared::FUNCTION;
+            currentScope++;
 
-                int scopeToUse;
-                if (node->value == "GlobalDecl") {
-                    scopeToUse = 0;
-                } else {
-                    scopeToUse = currentScope;
-                }
+            if (isFunction) {
+                table.insert(decl.name, SYM_FUNCTION, decl.type, false, 0, currentScope, decl.offset);
+            } else {
+                table.insert(decl.name, SYM_PROCEDURE, SYM_NOT_APPLICABLE, false, 0, currentScope, decl.offset);
+            }
 
-                SymbolTableEntry* existingVar = table.findInScope(name, scopeToUse);
-                if (existingVar && (existingVar->identifierType == "datatype" || existingVar->identifierType == "parameter")) {
-                    if (scopeToUse == 0) {
-                        std::cerr << "Error on line " << lineToReport << ": variable \"" << name
-                             << "\" is already defined globally" << std::endl;
-                    } else {
-                        std::cerr << "Error on line " << lineToReport << ": variable \"" << name
-                             << "\" is already defined locally" << std::endl;
-                    }
-                    exit(1);
+            ParameterList paramList;
+            paramList.functionName = decl.name;
+            for (; i + 1 < declarations.size() && declarations[i + 1].kind == Declared::PARAMETER; i++) {
+                const Declared& param = declarations[i + 1];
+                int arraySize = 0;
+                if (param.isArray && param.size != SYM_NONE) {
+                    arraySize = arraySizeOf(param.size, param.sizeOffset, param.name, table);
                 }
 
-                if (scopeToUse > 0) {
-                    SymbolTableEntry* globalVar = table.findInScope(name, 0);
-                    if (globalVar && (globalVar->identifierType == "datatype" || globalVar->identifierType == "parameter")) {
-                        std::cerr << "Error on line " << lineToReport << ": variable \"" << name
-                             << "\" is already defined globally" << std::endl;
-                        exit(1);
-                    }
-                }
+                paramList.params.push_back({param.name, param.type, currentScope, param.isArray, arraySize});
+                table.insert(param.name, SYM_PARAMETER_TYPE, param.type, param.isArray, arraySize, currentScope, param.offset);
+            }
 
-                table.insert(name, "datatype", type, isArray, size, scopeToUse, lineToReport);
+            // A procedure without parameters has no list
+            if (isFunction || !paramList.params.empty()) {
+                parameterLists.push_back(paramList);
+            }
+        } else {
+            int size = 0;
+            if (decl.isArray) {
+                size = arraySizeOf(decl.size, decl.sizeOffset, decl.name, table);
             }
-            var = var->rightSibling;
+
+            int scope;
+            if (decl.kind == Declared::GLOBAL) {
+                scope = 0;
+            } else {
+                scope = currentScope;
+            }
+            declareVariable(decl.name, decl.type, decl.isArray, size, scope, decl.offset, table);
         }
     }
-
-    if (node->leftChild)
-        buildSymbolTable(node->leftChild, table, currentScope, parameterLists);
-
-    if (node->rightSibling)
-        buildSymbolTable(node->rightSibling, table, currentScope, parameterLists);
 }
 
 void SymbolTableBuilder::printParameterLists(const std::vector<ParameterList>& parameterLists) {
     for (const auto& paramList : parameterLists) {
         std::cout << std::endl;
-        std::cout << "   PARAMETER LIST FOR: " << paramList.functionName << std::endl;
+        std::cout << "   PARAMETER LIST FOR: " << Interner::spelling(paramList.functionName) << std::endl;
         for (const auto& param : paramList.params) {
-            std::cout << "      IDENTIFIER_NAME: " << std::get<0>(param) << std::endl;
-            std::cout << "             DATATYPE: " << std::get<1>(param) << std::endl;
+            std::cout << "      IDENTIFIER_NAME: " << Interner::spelling(std::get<0>(param)) << std::endl;
+            std::cout << "             DATATYPE: " << Interner::spelling(std::get<1>(param)) << std::endl;
             std::cout << "    DATATYPE_IS_ARRAY: ";
             if (std::get<3>(param)) {
                 std::cout << "yes";
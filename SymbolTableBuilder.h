@@ -6,40 +6,78 @@
 #include <vector>
 #include <tuple>
 
+// Names and types are interned; Interner::spelling() gives the text back.
+// offset is where the name is declared; the table's LineTable gives its line.
 struct SymbolTableEntry {
-    std::string identifierName;
-    std::string identifierType;
-    std::string dataType;
+    Symbol identifierName;
+    Symbol identifierType;
+    Symbol dataType;
     bool isArray;
     int arraySize;
     int scope;
-    int line;
+    uint32_t offset;
     SymbolTableEntry* next;
 
-    SymbolTableEntry(std::string name, std::string idType, std::string dtype, bool array, int arrSize, int sc, int ln);
+    SymbolTableEntry(Symbol name, Symbol idType, Symbol dtype, bool array, int arrSize, int sc, uint32_t off);
 };
 
 class SymbolTable {
 public:
     SymbolTableEntry* head;
     SymbolTableEntry* tail;
+    const LineTable& lines;     // over the source the entries were declared in
 
-    SymbolTable();
-    SymbolTableEntry* findInScope(std::string name, int scope);
-    void insert(std::string name, std::string idType, std::string dtype, bool isArray, int arrSize, int scope, int line);
+    explicit SymbolTable(const LineTable& lines);
+    SymbolTableEntry* findInScope(Symbol name, int scope);
+    void insert(Symbol name, Symbol idType, Symbol dtype, bool isArray, int arrSize, int scope, uint32_t offset);
     void print();
 };
 
+// A declaration as collectDeclarations() finds it, in source order, so the
+// table can be built from one top-level unit's CST at a time. Parameters
+// follow the routine they belong to and locals belong to the routine before
+// them. Spellings are interned as in CST leaves.
+struct Declared {
+    enum Kind : uint8_t { FUNCTION, PROCEDURE, PARAMETER, LOCAL, GLOBAL };
+
+    Kind kind;
+    bool isArray;
+    Symbol name;
+    uint32_t offset;        // where the name is
+    Symbol type;            // SYM_NONE for a procedure
+    Symbol size;            // what is written between an array's brackets, or SYM_NONE
+    uint32_t sizeOffset;
+};
+
 struct ParameterList {
-    std::string functionName;
-    std::vector<std::tuple<std::string, std::string, int, bool, int>> params;
+    Symbol functionName;
+    std::vector<std::tuple<Symbol, Symbol, int, bool, int>> params;
 };
 
 class SymbolTableBuilder {
 public:
-    static void buildSymbolTable(TreeNode* node, SymbolTable& table, int& currentScope,
+    // Builds the table for a "Program" node or one top-level unit: collectDeclarations(),
+    // then the overload below
+    static void buildSymbolTable(TreeRef node, SymbolTable& table, int& currentScope,
                                   std::vector<ParameterList>& parameterLists);
+    // Same entries, checks and parameter lists, from what collectDeclarations() recorded
+    static void buildSymbolTable(const std::vector<Declared>& declarations, SymbolTable& table,
+                                 int& currentScope, std::vector<ParameterList>& parameterLists);
+    // Appends the declarations in a "Program" node or one top-level unit, in source
+    // order. Only statements that can hold a block are entered, and with a list of
+    // nodes still to visit rather than recursion, so deep nesting is safe.
+    static void collectDeclarations(TreeRef node, std::vector<Declared>& declarations);
     static void printParameterLists(const std::vector<ParameterList>& parameterLists);
+
+private:
+    // The value of an array size written in the source; exits if it is not
+    // an integer literal that fits in an int
+    static int arraySizeOf(Symbol size, uint32_t offset, Symbol name, const SymbolTable& table);
+
+    // Enters a variable into scope, exiting if the scope or the globals
+    // already define it
+    static void declareVariable(Symbol name, Symbol type, bool isArray, int size, int scope,
+                                uint32_t offset, SymbolTable& table);
 };
 
 #endif
@@ -1,276 +1,908 @@
 #include "Tokenizer.h"
-#include <cctype>
+#include "IncrementalTokenizer.h"
+#include "LiteralPool.h"
+#include "ByteSearch.h"
+#include "SourceBuffer.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <iostream>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
+namespace {
+
+// What the tokenizer does on the first byte of a token. Every byte value maps
+// to exactly one class, so the start state is a single table lookup followed
+// by a jump instead of a chain of comparisons.
+enum CharClass : uint8_t {
+    CC_OTHER,       // not part of the language; becomes a TOKEN_ERROR
+    CC_END,         // '\0': end of input
+    CC_BLANK,       // ' ', '\t'
+    CC_NEWLINE,     // '\n'
+    CC_SINGLE,      // always a one-byte token: ( ) [ ] { } ; , + % ^
+    CC_OPERATOR,    // < > = ! & |: one byte, or two when followed by pairedWith
+    CC_MINUS,       // '-': operator, or the sign of an integer
+    CC_STAR,        // '*'
+    CC_SLASH,       // '/': operator, or the start of a comment
+    CC_QUOTE,       // '"', '\''
+    CC_DIGIT,
+    CC_LETTER       // letters and '_'
+};
+
+// Per-byte properties tested inside the run loops
+enum CharFlag : uint8_t {
+    CF_DIGIT = 1,
+    CF_HEX = 2,
+    CF_IDENTIFIER = 4   // letter, digit or '_'
+};
+
+struct CharTables {
+    array<CharClass, 256> charClass{};
+    array<uint8_t, 256> flags{};
+    array<TokenType, 256> singleType{};     // type of the one-byte token
+    array<TokenType, 256> pairedType{};     // type of the two-byte token
+    array<char, 256> pairedWith{};          // second byte that forms it
+};
+
+constexpr CharTables buildCharTables() {
+    CharTables t{};
+    for (int c = 0; c < 256; c++) {
+        t.charClass[c] = CC_OTHER;
+        t.singleType[c] = TOKEN_ERROR;
+        t.pairedType[c] = TOKEN_ERROR;
+    }
+
+    for (int c = '0'; c <= '9'; c++) {
+        t.charClass[c] = CC_DIGIT;
+        t.flags[c] = CF_DIGIT | CF_HEX | CF_IDENTIFIER;
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+        t.charClass[c] = CC_LETTER;
+        t.charClass[c - 'a' + 'A'] = CC_LETTER;
+        t.flags[c] = CF_IDENTIFIER | (c <= 'f' ? CF_HEX : 0);
+        t.flags[c - 'a' + 'A'] = t.flags[c];
+    }
+    t.charClass['_'] = CC_LETTER;
+    t.flags['_'] = CF_IDENTIFIER;
+
+    t.charClass[0] = CC_END;
+    t.charClass[' '] = CC_BLANK;
+    t.charClass['\t'] = CC_BLANK;
+    t.charClass['\n'] = CC_NEWLINE;
+    t.charClass['"'] = CC_QUOTE;
+    t.charClass['\''] = CC_QUOTE;
+
+    const char singles[] = "()[]{};,+%^";
+    const TokenType singleTypes[] = {L_PAREN, R_PAREN, L_BRACKET, R_BRACKET, L_BRACE, R_BRACE,
+                                     SEMICOLON, COMMA, PLUS, MODULO, CARET};
+    for (int k = 0; singles[k]; k++) {
+        t.charClass[static_cast<unsigned char>(singles[k])] = CC_SINGLE;
+        t.singleType[static_cast<unsigned char>(singles[k])] = singleTypes[k];
+    }
+
+    const char operators[] = "<>=!&|";
+    const char seconds[] = "====&|";
+    const TokenType oneByte[] = {LT, GT, ASSIGNMENT_OPERATOR, BOOLEAN_NOT, TOKEN_ERROR, TOKEN_ERROR};
+    const TokenType twoByte[] = {LT_EQUAL, GT_EQUAL, BOOLEAN_EQUAL, BOOLEAN_NOT_EQUAL, BOOLEAN_AND, BOOLEAN_OR};
+    for (int k = 0; operators[k]; k++) {
+        unsigned char c = static_cast<unsigned char>(operators[k]);
+        t.charClass[c] = CC_OPERATOR;
+        t.singleType[c] = oneByte[k];
+        t.pairedType[c] = twoByte[k];
+        t.pairedWith[c] = seconds[k];
+    }
+
+    t.charClass['-'] = CC_MINUS;
+    t.singleType['-'] = MINUS;
+    t.charClass['*'] = CC_STAR;
+    t.singleType['*'] = ASTERISK;
+    t.charClass['/'] = CC_SLASH;
+    t.singleType['/'] = DIVIDE;
+    return t;
+}
+
+constexpr CharTables tables = buildCharTables();
+
+// Symbol of every token type whose spelling is fixed; SYM_NONE for the rest
+constexpr array<Symbol, END_OF_FILE + 1> buildFixedSymbols() {
+    array<Symbol, END_OF_FILE + 1> symbols{};
+    const TokenType types[] = {L_PAREN, R_PAREN, L_BRACKET, R_BRACKET, L_BRACE, R_BRACE, SEMICOLON, COMMA,
+                               ASSIGNMENT_OPERATOR, PLUS, MINUS, ASTERISK, DIVIDE, MODULO, CARET, LT, GT,
+                               LT_EQUAL, GT_EQUAL, BOOLEAN_AND, BOOLEAN_OR, BOOLEAN_NOT, BOOLEAN_EQUAL,
+                               BOOLEAN_NOT_EQUAL};
+    const Symbol spelled[] = {SYM_L_PAREN, SYM_R_PAREN, SYM_L_BRACKET, SYM_R_BRACKET, SYM_L_BRACE, SYM_R_BRACE,
+                              SYM_SEMICOLON, SYM_COMMA, SYM_ASSIGN, SYM_PLUS, SYM_MINUS, SYM_ASTERISK,
+                              SYM_DIVIDE, SYM_MODULO, SYM_CARET, SYM_LT, SYM_GT, SYM_LT_EQUAL, SYM_GT_EQUAL,
+                              SYM_BOOLEAN_AND, SYM_BOOLEAN_OR, SYM_BOOLEAN_NOT, SYM_BOOLEAN_EQUAL,
+                              SYM_BOOLEAN_NOT_EQUAL};
+    for (size_t k = 0; k < sizeof(types) / sizeof(types[0]); k++) {
+        symbols[types[k]] = spelled[k];
+    }
+    for (int type = KEYWORD_INT; type <= KEYWORD_FALSE; type++) {
+        symbols[type] = SYM_INT + (type - KEYWORD_INT);
+    }
+    return symbols;
+}
+
+constexpr array<Symbol, END_OF_FILE + 1> fixedSymbols = buildFixedSymbols();
+
+// Reserved words are found with a perfect hash on (first byte, last byte,
+// length). The multiplier is searched for at compile time so that every
+// keyword lands in its own slot; a lookup is then one hash and one compare.
+struct Keyword {
+    string_view spelling;
+    TokenType type;
+};
+
+constexpr Keyword keywords[] = {
+    {"int", KEYWORD_INT}, {"char", KEYWORD_CHAR}, {"void", KEYWORD_VOID}, {"bool", KEYWORD_BOOL},
+    {"function", KEYWORD_FUNCTION}, {"procedure", KEYWORD_PROCEDURE}, {"if", KEYWORD_IF},
+    {"else", KEYWORD_ELSE}, {"while", KEYWORD_WHILE}, {"for", KEYWORD_FOR},
+    {"return", KEYWORD_RETURN}, {"printf", KEYWORD_PRINTF}, {"TRUE", KEYWORD_TRUE}, {"FALSE", KEYWORD_FALSE}
+};
+
+constexpr size_t KEYWORD_COUNT = sizeof(keywords) / sizeof(keywords[0]);
+constexpr int KEYWORD_SLOT_BITS = 5;
+constexpr size_t KEYWORD_SLOTS = 1 << KEYWORD_SLOT_BITS;
+constexpr size_t MIN_KEYWORD_LENGTH = 2;
+constexpr size_t MAX_KEYWORD_LENGTH = 9;
+
+constexpr size_t keywordSlot(string_view word, uint32_t multiplier) {
+    uint32_t key = (static_cast<unsigned char>(word.front()) << 16)
+                 | (static_cast<unsigned char>(word.back()) << 8)
+                 | static_cast<uint32_t>(word.size());
+    return (key * multiplier) >> (32 - KEYWORD_SLOT_BITS);
+}
+
+constexpr uint32_t findKeywordMultiplier() {
+    for (uint32_t multiplier = 0x9E3779B1u; ; multiplier += 2) {
+        bool used[KEYWORD_SLOTS] = {};
+        bool collision = false;
+        for (size_t k = 0; k < KEYWORD_COUNT && !collision; k++) {
+            size_t slot = keywordSlot(keywords[k].spelling, multiplier);
+            collision = used[slot];
+            used[slot] = true;
+        }
+        if (!collision) {
+            return multiplier;
+        }
+    }
+}
+
+constexpr uint32_t keywordMultiplier = findKeywordMultiplier();
+
+// Slot -> index into keywords, or -1
+constexpr array<int8_t, KEYWORD_SLOTS> buildKeywordTable() {
+    array<int8_t, KEYWORD_SLOTS> table{};
+    for (size_t k = 0; k < KEYWORD_SLOTS; k++) {
+        table[k] = -1;
+    }
+    for (size_t k = 0; k < KEYWORD_COUNT; k++) {
+        table[keywordSlot(keywords[k].spelling, keywordMultiplier)] = static_cast<int8_t>(k);
+    }
+    return table;
+}
+
+constexpr array<int8_t, KEYWORD_SLOTS> keywordTable = buildKeywordTable();
+
+inline TokenType lookupKeyword(string_view word) {
+    if (word.size() < MIN_KEYWORD_LENGTH || word.size() > MAX_KEYWORD_LENGTH) {
+        return IDENTIFIER;
+    }
+    int k = keywordTable[keywordSlot(word, keywordMultiplier)];
+    if (k < 0 || keywords[k].spelling != word) {
+        return IDENTIFIER;
+    }
+    return keywords[k].type;
+}
+
+const size_t MIN_PARALLEL_SHARD = 1 << 20;
+
+// Returns the end of the identifier run that continues at p[i]. Sixteen bytes
+// are classified at a time so the length of an identifier costs one branch
+// rather than one per byte.
+size_t identifierEnd(const char* p, size_t i, size_t n) {
+#if defined(__SSE2__)
+    const __m128i lowerA = _mm_set1_epi8(static_cast<char>('a' + 128));
+    const __m128i zero = _mm_set1_epi8(static_cast<char>('0' + 128));
+    const __m128i letterLimit = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const __m128i digitLimit = _mm_set1_epi8(static_cast<char>(-128 + 10));
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i underscore = _mm_set1_epi8('_');
+    while (n - i >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        // Biased signed compares stand in for the unsigned range checks
+        // 'a' <= (b | 0x20) <= 'z' and '0' <= b <= '9'
+        __m128i letter = _mm_cmplt_epi8(_mm_sub_epi8(_mm_or_si128(chunk, caseBit), lowerA), letterLimit);
+        __m128i digit = _mm_cmplt_epi8(_mm_sub_epi8(chunk, zero), digitLimit);
+        __m128i hits = _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(chunk, underscore));
+        unsigned misses = ~static_cast<unsigned>(_mm_movemask_epi8(hits)) & 0xFFFF;
+        if (misses) {
+            return i + __builtin_ctz(misses);
+        }
+        i += 16;
+    }
+#endif
+    while (i < n && (tables.flags[static_cast<unsigned char>(p[i])] & CF_IDENTIFIER)) {
+        i++;
+    }
+    return i;
+}
+
+// Calls visit(k), in order, for each k in [from, n) whose kind is one of
+// kinds, until visit returns false. Returns the k it stopped at, or n.
+template <size_t N, class Visit>
+size_t scanKinds(const uint8_t* types, size_t from, size_t n, const array<TokenType, N>& kinds, Visit visit) {
+    size_t k = from;
+#if defined(__SSE2__)
+    __m128i wanted[N];
+    for (size_t w = 0; w < N; w++) {
+        wanted[w] = _mm_set1_epi8(static_cast<char>(kinds[w]));
+    }
+    for (; k < n && n - k >= 16; k += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(types + k));
+        __m128i hits = _mm_cmpeq_epi8(chunk, wanted[0]);
+        for (size_t w = 1; w < N; w++) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, wanted[w]));
+        }
+        for (unsigned mask = _mm_movemask_epi8(hits); mask; mask &= mask - 1) {
+            size_t at = k + __builtin_ctz(mask);
+            if (!visit(at)) {
+                return at;
+            }
+        }
+    }
+#endif
+    for (; k < n; k++) {
+        if (find(kinds.begin(), kinds.end(), types[k]) != kinds.end() && !visit(k)) {
+            return k;
+        }
+    }
+    return n;
+}
+
+// Joins the tokens of one shard, from token from on, onto those of the
+// shards before it
+void appendTokens(vector<Token>& tokens, const vector<Token>& shard, size_t from) {
+    tokens.insert(tokens.end(), shard.begin() + from, shard.end());
+}
+
+void appendTokens(TokenStore& tokens, const TokenStore& shard, size_t from) {
+    tokens.append(shard, from);
+}
+
+uint32_t offsetOf(const vector<Token>& tokens, size_t k) {
+    return tokens[k].offset;
+}
+
+uint32_t offsetOf(const TokenStore& tokens, size_t k) {
+    return tokens.span(k).offset;
+}
+
+// Index of the first of tokens that starts at or after offset
+template <class Tokens>
+size_t firstTokenFrom(const Tokens& tokens, size_t offset) {
+    size_t lo = 0;
+    size_t hi = tokens.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (offsetOf(tokens, mid) < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// The token for the quoted string input[start, end), its literal recorded
+Token stringToken(string_view input, size_t start, size_t end, Interner::Cache& symbols) {
+    string_view spelling = input.substr(start, end - start);
+    const bool doubled = spelling.front() == '"';
+    Symbol symbol = symbols.intern(spelling);
+    LiteralPool::text(symbol, doubled ? Literal::STRING_LITERAL : Literal::CHAR_LITERAL, spelling);
+    return Token(doubled ? DOUBLE_QUOTED_STRING : SINGLE_QUOTED_STRING, static_cast<uint32_t>(start),
+                 static_cast<uint32_t>(spelling.size()), symbol);
+}
+
+// How a shard can be entered, given the way the shard before it ended:
+// between tokens, or inside a block comment or a string left open
+enum ShardEntry {
+    ENTER_BETWEEN_TOKENS,
+    ENTER_COMMENT,
+    ENTER_DOUBLE_QUOTED,
+    ENTER_SINGLE_QUOTED,
+    SHARD_ENTRIES
+};
+
+// How many of a shard's tokens lexing it from inside a comment or string
+// tries to meet before it carries on alone
+const size_t MAX_MEETING_POINTS = 256;
+
+}
+
 bool Tokenizer::isHexDigit(char c) {
-    if (c >= '0' && c <= '9') return true;
-    if (c >= 'A' && c <= 'F') return true;
-    if (c >= 'a' && c <= 'f') return true;
-    return false;
+    return tables.flags[static_cast<unsigned char>(c)] & CF_HEX;
 }
 
-bool Tokenizer::isLetterOrUnderscore(char c) {
-    return isalpha(c) || c == '_';
+bool Tokenizer::isDigit(char c) {
+    return tables.flags[static_cast<unsigned char>(c)] & CF_DIGIT;
 }
 
-bool Tokenizer::isLetterDigitOrUnderscore(char c) {
-    return isalnum(c) || c == '_';
+TokenType Tokenizer::keywordType(string_view word) {
+    return lookupKeyword(word);
 }
 
-vector<Token> Tokenizer::tokenize(const string& input) {
+void Tokenizer::reportError(LexStatus status, string_view input, size_t offset) {
+    int line = LineTable(input).line(static_cast<uint32_t>(offset));
+    if (status == LEX_UNTERMINATED_COMMENT) {
+        cerr << "ERROR: Program contains C-style, unterminated comment on line " << line << endl;
+    } else if (status == LEX_UNTERMINATED_STRING) {
+        cerr << "Syntax error on line " << line << ": unterminated string quote." << endl;
+    } else {
+        cerr << "Syntax error on line " << line << ": token is longer than " << MAX_TOKEN_LENGTH << " bytes." << endl;
+    }
+    exit(1);
+}
+
+vector<Token> Tokenizer::tokenize(string_view input, vector<Token>* trivia) {
     vector<Token> tokens;
-    TokenizerState state = TOKENIZER_START;
-    string currentToken = "";
-    int line = 1;
-    int column = 1;
-    int tokenStartColumn = 1;
-    bool inEscape = false;
-    int hexDigitCount = 0;
-
-    for (size_t i = 0; i <= input.length(); i++) {
-        char c;
-        if (i < input.length()) {
-            c = input[i];
-        } else {
-            c = '\0';
+    // Real programs run about one significant token per four bytes; untouched
+    // capacity costs address space only, and it saves the regrowth copies.
+    tokens.reserve(input.length() / 4 + 1);
+    Interner::Cache symbols;
+    LexResult r = lex(input, 0, vector<size_t>(), SIZE_MAX, symbols, tokens, trivia);
+    if (r.status >= LEX_UNTERMINATED_COMMENT) {
+        reportError(r.status, input, r.end);
+    }
+    return tokens;
+}
+
+TokenStore Tokenizer::tokenizeStore(string_view input, vector<Token>* trivia) {
+    TokenStore tokens;
+    tokens.reserve(input.length() / 4 + 1);
+    Interner::Cache symbols;
+    LexResult r = lex(input, 0, vector<size_t>(), SIZE_MAX, symbols, tokens, trivia);
+    if (r.status >= LEX_UNTERMINATED_COMMENT) {
+        reportError(r.status, input, r.end);
+    }
+    return tokens;
+}
+
+// The input is cut into one shard per thread, each starting just after a
+// newline, and every shard is lexed up to the next one's start. Only block
+// comments and strings with an escaped newline continue across a newline, so
+// a shard is entered either between tokens or inside one of those, and the
+// way in is known only once the shard before it has been lexed. Each shard
+// is therefore lexed every way in at once: from the start state, and from
+// inside a comment and inside either kind of string. The last three skip the
+// body of the construct and then lex on only until they meet the first at
+// the start of one of its tokens; from there the lexer's state is the same,
+// so the rest of the shard is shared. Once all are done the shards are
+// chained from the first, each taken the way the one before it ended. Tokens
+// record absolute offsets, so they need no fixing up when they are joined.
+vector<Token> Tokenizer::tokenizeParallel(string_view input, unsigned threads, vector<Token>* trivia) {
+    vector<Token> tokens;
+    LexResult r = lexParallel(input, threads, tokens, trivia);
+    if (r.status >= LEX_UNTERMINATED_COMMENT) {
+        reportError(r.status, input, r.end);
+    }
+    return tokens;
+}
+
+bool Tokenizer::tryTokenizeParallel(string_view input, TokenStore& tokens, unsigned threads) {
+    return lexParallel(input, threads, tokens, nullptr).status < LEX_UNTERMINATED_COMMENT;
+}
+
+template <class Sink>
+Tokenizer::LexResult Tokenizer::lexParallel(string_view input, unsigned threads, Sink& tokens,
+                                            vector<Token>* trivia) {
+    if (threads == 0) {
+        threads = thread::hardware_concurrency();
+    }
+    size_t shardCount = min<size_t>(threads, input.size() / MIN_PARALLEL_SHARD);
+    if (shardCount <= 1) {
+        tokens.reserve(input.length() / 4 + 1);
+        Interner::Cache symbols;
+        return lex(input, 0, vector<size_t>(), SIZE_MAX, symbols, tokens, trivia);
+    }
+
+    const char* data = input.data();
+    vector<size_t> bounds(1, 0);
+    for (size_t k = 1; k < shardCount; k++) {
+        size_t at = max(input.size() / shardCount * k, bounds.back());
+        const void* nl = memchr(data + at, '\n', input.size() - at);
+        if (!nl) {
+            break;
         }
+        size_t next = static_cast<const char*>(nl) - data + 1;
+        if (next > bounds.back() && next < input.size()) {
+            bounds.push_back(next);
+        }
+    }
+    shardCount = bounds.size();
 
-        switch (state) {
-            case TOKENIZER_START:
-                tokenStartColumn = column;
-                currentToken = "";
+    // A shard lexed one way in. Lexing from inside a comment or string
+    // begins where that closes and, if it meets the lexing from the start
+    // state, continues with its tokens from token joined on.
+    struct Entered {
+        Sink tokens;
+        vector<Token> trivia;
+        LexResult result;
+        size_t closed = SIZE_MAX;
+        size_t joined = SIZE_MAX;
+    };
+    vector<array<Entered, SHARD_ENTRIES> > shards(shardCount);
+    vector<thread> workers;
 
-                if (c == '\0') {
-                    tokens.push_back({END_OF_FILE, "", line, column});
-                    return tokens;
-                }
-                else if (c == ' ' || c == '\t') {
-                    tokens.push_back({WHITESPACE, string(1, c), line, tokenStartColumn});
-                }
-                else if (c == '\n') {
-                    tokens.push_back({NEWLINE, "\\n", line, tokenStartColumn});
-                }
-                else if (c == '(') tokens.push_back({L_PAREN, "(", line, tokenStartColumn});
-                else if (c == ')') tokens.push_back({R_PAREN, ")", line, tokenStartColumn});
-                else if (c == '[') tokens.push_back({L_BRACKET, "[", line, tokenStartColumn});
-                else if (c == ']') tokens.push_back({R_BRACKET, "]", line, tokenStartColumn});
-                else if (c == '{') tokens.push_back({L_BRACE, "{", line, tokenStartColumn});
-                else if (c == '}') tokens.push_back({R_BRACE, "}", line, tokenStartColumn});
-                else if (c == ';') tokens.push_back({SEMICOLON, ";", line, tokenStartColumn});
-                else if (c == ',') tokens.push_back({COMMA, ",", line, tokenStartColumn});
-                else if (c == '+') tokens.push_back({PLUS, "+", line, tokenStartColumn});
-                else if (c == '-') {
-                    if (i + 1 < input.length() && isdigit(input[i + 1])) {
-                        currentToken = "-";
-                        state = TOKENIZER_INTEGER;
-                    } else {
-                        tokens.push_back({MINUS, "-", line, tokenStartColumn});
-                    }
-                }
-                else if (c == '*') tokens.push_back({ASTERISK, "*", line, tokenStartColumn});
-                else if (c == '/') tokens.push_back({DIVIDE, "/", line, tokenStartColumn});
-                else if (c == '%') tokens.push_back({MODULO, "%", line, tokenStartColumn});
-                else if (c == '^') tokens.push_back({CARET, "^", line, tokenStartColumn});
-                else if (c == '<') {
-                    currentToken = "<";
-                    state = TOKENIZER_LT;
-                }
-                else if (c == '>') {
-                    currentToken = ">";
-                    state = TOKENIZER_GT;
-                }
-                else if (c == '=') {
-                    currentToken = "=";
-                    state = TOKENIZER_EQUAL;
-                }
-                else if (c == '!') {
-                    currentToken = "!";
-                    state = TOKENIZER_NOT;
-                }
-                else if (c == '&') {
-                    currentToken = "&";
-                    state = TOKENIZER_AND;
-                }
-                else if (c == '|') {
-                    currentToken = "|";
-                    state = TOKENIZER_OR;
-                }
-                else if (c == '"') {
-                    currentToken = "\"";
-                    state = TOKENIZER_DOUBLE_STRING;
+    for (size_t k = 0; k < shardCount; k++) {
+        workers.emplace_back([&, k]() {
+            const size_t limit = k + 1 < shardCount ? bounds[k + 1] : SIZE_MAX;
+            Interner::Cache symbols;
+            Entered& plain = shards[k][ENTER_BETWEEN_TOKENS];
+            // The first shard's tokens become the result, so they are sized for all of them
+            plain.tokens.reserve((k == 0 ? input.size() : min(limit, input.size()) - bounds[k]) / 4 + 1);
+            plain.result = lex(input, bounds[k], vector<size_t>(), SIZE_MAX, symbols, plain.tokens,
+                               trivia ? &plain.trivia : nullptr, limit);
+
+            for (int entry = ENTER_COMMENT; k > 0 && entry < SHARD_ENTRIES; entry++) {
+                Entered& inside = shards[k][entry];
+                LexResult r = entry == ENTER_COMMENT
+                                  ? skipComment(input, bounds[k], limit, nullptr)
+                                  : skipString(input, bounds[k], entry == ENTER_DOUBLE_QUOTED ? '"' : '\'', limit);
+                if (r.status != LEX_STOPPED) {
+                    inside.result = r;
+                    continue;
                 }
-                else if (c == '\'') {
-                    currentToken = "'";
-                    state = TOKENIZER_SINGLE_STRING;
+                inside.closed = entry == ENTER_COMMENT ? r.end : r.end + 1;
+                size_t first = firstTokenFrom(plain.tokens, inside.closed);
+                vector<size_t> meetings;
+                for (size_t t = first; t < plain.tokens.size() && meetings.size() < MAX_MEETING_POINTS; t++) {
+                    meetings.push_back(offsetOf(plain.tokens, t));
                 }
-                else if (isdigit(c)) {
-                    currentToken = c;
-                    state = TOKENIZER_INTEGER;
+                inside.result = lex(input, inside.closed, meetings, SIZE_MAX, symbols, inside.tokens,
+                                    trivia ? &inside.trivia : nullptr, limit);
+                if (inside.result.status == LEX_STOPPED && inside.result.end != limit) {
+                    inside.joined = first + (lower_bound(meetings.begin(), meetings.end(), inside.result.end)
+                                             - meetings.begin());
                 }
-                else if (isLetterOrUnderscore(c)) {
-                    currentToken = c;
-                    state = TOKENIZER_IDENTIFIER;
+            }
+        });
+    }
+    for (size_t k = 0; k < workers.size(); k++) {
+        workers[k].join();
+    }
+
+    // Chain the shards from the first, each entered the way the one before it ended
+    Interner::Cache symbols;
+    LexResult r = {LEX_STOPPED, 0};
+    for (size_t k = 0;; k++) {
+        ShardEntry entry = ENTER_BETWEEN_TOKENS;
+        if (r.status == LEX_STOPPED_IN_COMMENT) {
+            entry = ENTER_COMMENT;
+        } else if (r.status == LEX_STOPPED_IN_STRING) {
+            entry = input[r.start] == '"' ? ENTER_DOUBLE_QUOTED : ENTER_SINGLE_QUOTED;
+        }
+        const size_t start = r.start;
+        Entered& lexed = shards[k][entry];
+        Entered& plain = shards[k][ENTER_BETWEEN_TOKENS];
+
+        if (entry == ENTER_COMMENT && trivia) {
+            // The newlines in the comment body were not kept while guessing
+            skipComment(input, bounds[k], k + 1 < shardCount ? bounds[k + 1] : SIZE_MAX, trivia);
+        }
+        if (entry != ENTER_BETWEEN_TOKENS && lexed.closed == SIZE_MAX) {
+            // The comment or string runs on past this shard, or into an error
+            r = lexed.result;
+            r.start = start;
+            if (r.status == LEX_UNTERMINATED_COMMENT) {
+                r.end = start;
+            }
+        } else {
+            if (entry >= ENTER_DOUBLE_QUOTED) {
+                if (lexed.closed - start > MAX_TOKEN_LENGTH) {
+                    return {LEX_TOKEN_TOO_LONG, start};
                 }
-                else {
-                    tokens.push_back({TOKEN_ERROR, string(1, c), line, tokenStartColumn});
+                tokens.push_back(stringToken(input, start, lexed.closed, symbols));
+            }
+            if (k == 0) {
+                tokens = move(lexed.tokens);
+            } else {
+                appendTokens(tokens, lexed.tokens, 0);
+            }
+            if (trivia) {
+                trivia->insert(trivia->end(), lexed.trivia.begin(), lexed.trivia.end());
+            }
+            r = lexed.result;
+            if (lexed.joined != SIZE_MAX) {
+                appendTokens(tokens, plain.tokens, lexed.joined);
+                if (trivia) {
+                    auto from = lower_bound(plain.trivia.begin(), plain.trivia.end(), r.end,
+                                            [](const Token& tok, size_t offset) { return tok.offset < offset; });
+                    trivia->insert(trivia->end(), from, plain.trivia.end());
                 }
-                break;
+                r = plain.result;
+            }
+        }
+        shards[k] = array<Entered, SHARD_ENTRIES>();
 
-            case TOKENIZER_LT:
-                if (c == '=') {
-                    tokens.push_back({LT_EQUAL, "<=", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                } else {
-                    tokens.push_back({LT, "<", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
-                }
-                break;
+        if (k + 1 == shardCount || r.status < LEX_STOPPED || r.status > LEX_STOPPED_IN_STRING) {
+            return r;
+        }
+    }
+}
+
+Tokenizer::LexResult Tokenizer::skipComment(string_view input, size_t from, size_t limit, vector<Token>* trivia) {
+    const char* p = input.data();
+    const size_t n = input.length();
+    const size_t searched = min(limit, n);
+    // Only a '*' can close the comment; newlines matter only when trivia is kept
+    const char newline = trivia ? '\n' : '*';
+    size_t end = from;
+    for (;;) {
+        end = findAny(p + end, p + searched, '*', '\0', newline, newline) - p;
+        if (end == limit) {
+            return {LEX_STOPPED_IN_COMMENT, end};
+        }
+        if (end >= n || p[end] == '\0') {
+            return {LEX_UNTERMINATED_COMMENT, end};
+        }
+        if (p[end++] == '\n') {
+            trivia->push_back({NEWLINE, static_cast<uint32_t>(end - 1), 1});
+        } else if (end < n && p[end] == '/') {
+            return {LEX_STOPPED, end + 1};
+        }
+    }
+}
 
-            case TOKENIZER_GT:
-                if (c == '=') {
-                    tokens.push_back({GT_EQUAL, ">=", line, tokenStartColumn});
-                    state = TOKENIZER_START;
+Tokenizer::LexResult Tokenizer::skipString(string_view input, size_t from, char quote, size_t limit) {
+    const char* p = input.data();
+    const size_t n = input.length();
+    size_t end = from;
+    for (;;) {
+        end = findAny(p + end, p + n, quote, '\\', '\n', '\0') - p;
+        const char b = end < n ? p[end] : '\0';
+        if (b == quote) {
+            return {LEX_STOPPED, end};
+        }
+        if (b == '\0' || b == '\n') {
+            return {LEX_UNTERMINATED_STRING, end};
+        }
+        end++;
+
+        // A backslash: the escaped byte is taken as is, even a newline. A
+        // backslash at the very end leaves the input without an
+        // END_OF_FILE token, as it always has.
+        if (end >= n) {
+            return {LEX_NO_END_OF_FILE, end};
+        }
+        // \x takes up to two hex digits; the spelling is the bytes
+        // as written.
+        const char escaped = p[end++];
+        if (escaped == 'x') {
+            int hexDigits = 0;
+            while (hexDigits < 2 && end < n && isHexDigit(p[end])) {
+                hexDigits++;
+                end++;
+            }
+        } else if (end == limit) {
+            // Only an escaped newline can reach a line start
+            return {LEX_STOPPED_IN_STRING, end};
+        }
+    }
+}
+
+// Each token is recognized by one dispatch on the class of its first byte,
+// after which identifiers, integers, comments and strings run in tight loops
+// over the flag table. Token text is never copied and lines are not counted;
+// only offsets are recorded, and a LineTable turns them into lines on demand.
+template <class Sink>
+Tokenizer::LexResult Tokenizer::lex(string_view input, size_t begin, const vector<size_t>& stops,
+                                    size_t maxTokens, Interner::Cache& symbols,
+                                    Sink& tokens, vector<Token>* trivia, size_t limit) {
+    const char* p = input.data();
+    const size_t n = input.length();
+    size_t i = begin;
+    size_t stop = 0;
+
+    // Stop k, or the limit if that comes first
+    auto stopAt = [&](size_t k) -> size_t {
+        return min(limit, k < stops.size() ? stops[k] : SIZE_MAX);
+    };
+    size_t nextStop = stopAt(0);
+
+    // Byte k, or '\0' past the end
+    auto at = [&](size_t k) -> char {
+        return k < n ? p[k] : '\0';
+    };
+
+    for (;;) {
+        // Stop offsets passed inside a comment or string are skipped
+        while (i >= nextStop) {
+            if (i == nextStop) {
+                return {LEX_STOPPED, i};
+            }
+            nextStop = stopAt(++stop);
+        }
+        if (tokens.size() >= maxTokens) {
+            return {LEX_STOPPED, i};
+        }
+
+        const uint32_t tokenStart = static_cast<uint32_t>(i);
+        const unsigned char c = static_cast<unsigned char>(at(i));
+
+        switch (tables.charClass[c]) {
+            case CC_END:
+                tokens.push_back({END_OF_FILE, tokenStart, 0});
+                return {LEX_END_OF_FILE, i};
+
+            case CC_BLANK:
+            case CC_NEWLINE:
+                if (trivia) {
+                    trivia->push_back({c == '\n' ? NEWLINE : WHITESPACE, tokenStart, 1});
+                    i++;
                 } else {
-                    tokens.push_back({GT, ">", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
+                    // A stop just after a newline is met before the
+                    // indentation that follows it, not skipped over
+                    const size_t limit = min(n, nextStop);
+                    do {
+                        i++;
+                    } while (i < limit && (p[i] == ' ' || p[i] == '\t' || p[i] == '\n'));
                 }
                 break;
 
-            case TOKENIZER_EQUAL:
-                if (c == '=') {
-                    tokens.push_back({BOOLEAN_EQUAL, "==", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                } else {
-                    tokens.push_back({ASSIGNMENT_OPERATOR, "=", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
-                }
+            case CC_SINGLE:
+                tokens.push_back({tables.singleType[c], tokenStart, 1, fixedSymbols[tables.singleType[c]]});
+                i++;
                 break;
 
-            case TOKENIZER_NOT:
-                if (c == '=') {
-                    tokens.push_back({BOOLEAN_NOT_EQUAL, "!=", line, tokenStartColumn});
-                    state = TOKENIZER_START;
+            case CC_OPERATOR:
+                if (at(i + 1) == tables.pairedWith[c]) {
+                    tokens.push_back({tables.pairedType[c], tokenStart, 2, fixedSymbols[tables.pairedType[c]]});
+                    i += 2;
                 } else {
-                    tokens.push_back({BOOLEAN_NOT, "!", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
+                    tokens.push_back({tables.singleType[c], tokenStart, 1, fixedSymbols[tables.singleType[c]]});
+                    i++;
                 }
                 break;
 
-            case TOKENIZER_AND:
-                if (c == '&') {
-                    tokens.push_back({BOOLEAN_AND, "&&", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                } else {
-                    tokens.push_back({TOKEN_ERROR, "&", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
+            case CC_MINUS:
+                if (!isDigit(at(i + 1))) {
+                    tokens.push_back({MINUS, tokenStart, 1, SYM_MINUS});
+                    i++;
+                    break;
                 }
-                break;
+                i++;
+                [[fallthrough]];
 
-            case TOKENIZER_OR:
-                if (c == '|') {
-                    tokens.push_back({BOOLEAN_OR, "||", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                } else {
-                    tokens.push_back({TOKEN_ERROR, "|", line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
+            case CC_DIGIT: {
+                size_t end = i + 1;
+                while (end < n && isDigit(p[end])) {
+                    end++;
+                }
+                if (end - tokenStart > MAX_TOKEN_LENGTH) {
+                    return {LEX_TOKEN_TOO_LONG, tokenStart};
                 }
+                string_view digits(p + tokenStart, end - tokenStart);
+                Symbol symbol = symbols.intern(digits);
+                LiteralPool::integer(symbol, digits);
+                tokens.push_back({INTEGER, tokenStart, static_cast<uint32_t>(digits.size()), symbol});
+                i = end;
                 break;
+            }
 
-            case TOKENIZER_INTEGER:
-                if (isdigit(c)) {
-                    currentToken += c;
-                } else {
-                    tokens.push_back({INTEGER, currentToken, line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
+            case CC_LETTER: {
+                size_t end = identifierEnd(p, i + 1, n);
+                if (end - tokenStart > MAX_TOKEN_LENGTH) {
+                    return {LEX_TOKEN_TOO_LONG, tokenStart};
                 }
+                string_view name(p + tokenStart, end - tokenStart);
+                TokenType type = lookupKeyword(name);
+                Symbol symbol = type == IDENTIFIER ? symbols.intern(name) : fixedSymbols[type];
+                tokens.push_back({type, tokenStart, static_cast<uint32_t>(name.size()), symbol});
+                i = end;
                 break;
+            }
 
-            case TOKENIZER_IDENTIFIER:
-                if (isLetterDigitOrUnderscore(c)) {
-                    currentToken += c;
-                } else {
-                    tokens.push_back({IDENTIFIER, currentToken, line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                    i--;
+            case CC_STAR:
+                if (at(i + 1) == '/') {
+                    return {LEX_UNTERMINATED_COMMENT, i};
                 }
+                tokens.push_back({ASTERISK, tokenStart, 1, SYM_ASTERISK});
+                i++;
                 break;
 
-            case TOKENIZER_DOUBLE_STRING:
-                currentToken += c;
-                if (inEscape) {
-                    if (c == 'x') {
-                        state = TOKENIZER_HEX_ESCAPE;
-                        hexDigitCount = 0;
+            // Comments are stripped here rather than in a separate pass so the
+            // source is only read once. Newlines inside comments still go to
+            // the trivia table to keep the line layout intact.
+            case CC_SLASH:
+                if (at(i + 1) == '/') {
+                    // A NUL byte ends the input just as the real end does
+                    size_t end = findAny(p + i + 2, p + n, '\n', '\0', '\n', '\0') - p;
+                    if (end < n && p[end] == '\n') {
+                        if (trivia) trivia->push_back({NEWLINE, static_cast<uint32_t>(end), 1});
+                        end++;
+                    }
+                    i = end;
+                } else if (at(i + 1) == '*') {
+                    LexResult r = skipComment(input, i + 2, limit, trivia);
+                    if (r.status == LEX_UNTERMINATED_COMMENT) {
+                        return {r.status, tokenStart};
                     }
-                    inEscape = false;
-                } else if (c == '\\') {
-                    inEscape = true;
-                } else if (c == '"') {
-                    tokens.push_back({DOUBLE_QUOTED_STRING, currentToken, line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                } else if (c == '\0' || c == '\n') {
-                    cerr << "Syntax error on line " << line << ": unterminated string quote." << endl;
-                    exit(1);
+                    if (r.status != LEX_STOPPED) {
+                        return {r.status, r.end, tokenStart};
+                    }
+                    i = r.end;
+                } else {
+                    tokens.push_back({DIVIDE, tokenStart, 1, SYM_DIVIDE});
+                    i++;
                 }
                 break;
 
-            case TOKENIZER_SINGLE_STRING:
-                currentToken += c;
-                if (inEscape) {
-                    if (c == 'x') {
-                        state = TOKENIZER_HEX_ESCAPE;
-                        hexDigitCount = 0;
-                    }
-                    inEscape = false;
-                } else if (c == '\\') {
-                    inEscape = true;
-                } else if (c == '\'') {
-                    tokens.push_back({SINGLE_QUOTED_STRING, currentToken, line, tokenStartColumn});
-                    state = TOKENIZER_START;
-                } else if (c == '\0' || c == '\n') {
-                    cerr << "Syntax error on line " << line << ": unterminated string quote." << endl;
-                    exit(1);
+            case CC_QUOTE: {
+                LexResult r = skipString(input, i + 1, static_cast<char>(c), limit);
+                if (r.status != LEX_STOPPED) {
+                    return {r.status, r.end, tokenStart};
                 }
+                if (r.end + 1 - tokenStart > MAX_TOKEN_LENGTH) {
+                    return {LEX_TOKEN_TOO_LONG, tokenStart};
+                }
+                tokens.push_back(stringToken(input, tokenStart, r.end + 1, symbols));
+                i = r.end + 1;
                 break;
+            }
 
-            case TOKENIZER_HEX_ESCAPE:
-                currentToken += c;
-                if (isHexDigit(c)) {
-                    hexDigitCount++;
-                    if (hexDigitCount == 2) {
-                        if (currentToken.find('"') != string::npos) {
-                            state = TOKENIZER_DOUBLE_STRING;
-                        } else {
-                            state = TOKENIZER_SINGLE_STRING;
-                        }
-                    }
-                } else {
-                    if (currentToken.find('"') != string::npos) {
-                        state = TOKENIZER_DOUBLE_STRING;
-                    } else {
-                        state = TOKENIZER_SINGLE_STRING;
-                    }
-                    i--;
-                }
+            // A stray UTF-8 character is one error token, not one per byte
+            case CC_OTHER:
+                do {
+                    i++;
+                } while (c >= 0x80 && i < n && (static_cast<unsigned char>(p[i]) & 0xC0) == 0x80);
+                tokens.push_back({TOKEN_ERROR, tokenStart, static_cast<uint32_t>(i - tokenStart)});
                 break;
         }
+    }
+}
+
+// IncrementalTokenizer lexes into a vector from its own translation unit
+template Tokenizer::LexResult Tokenizer::lex<vector<Token> >(string_view, size_t, const vector<size_t>&, size_t,
+                                                              Interner::Cache&, vector<Token>&, vector<Token>*,
+                                                              size_t);
+
+void TokenStore::reserve(size_t count) {
+    types.reserve(count);
+    spans.reserve(count);
+    symbols.reserve(count);
+}
+
+void TokenStore::append(const TokenStore& other, size_t from) {
+    types.insert(types.end(), other.types.begin() + from, other.types.end());
+    spans.insert(spans.end(), other.spans.begin() + from, other.spans.end());
+    symbols.insert(symbols.end(), other.symbols.begin() + from, other.symbols.end());
+}
+
+vector<size_t> TokenStore::routineStarts() const {
+    vector<size_t> starts;
+    int depth = 0;
+    scanKinds(types.data(), 0, size(), array<TokenType, 4>{L_BRACE, R_BRACE, KEYWORD_FUNCTION, KEYWORD_PROCEDURE},
+              [&](size_t k) {
+        if (types[k] == L_BRACE) {
+            depth++;
+        } else if (types[k] == R_BRACE) {
+            depth--;
+        } else if (depth == 0) {
+            starts.push_back(k);
+        }
+        return true;
+    });
+    return starts;
+}
+
+TokenStream::TokenStream(string_view input, size_t from)
+    : input(input), source(nullptr), store(nullptr), edited(nullptr), next(0), offset(from),
+      status(Tokenizer::LEX_STOPPED) {
+    // Room for a batch plus the lookahead carried over from the last one,
+    // so the buffer is allocated once
+    buffer.reserve(BATCH + LOOKAHEAD);
+    cursor = last = buffer.data();
+}
+
+TokenStream::TokenStream(SourceBuffer& source)
+    : input(source.view()), source(&source), store(nullptr), edited(nullptr), next(0), offset(0),
+      status(Tokenizer::LEX_STOPPED) {
+    buffer.reserve(BATCH + LOOKAHEAD);
+    cursor = last = buffer.data();
+}
+
+TokenStream::TokenStream(const vector<Token>& tokens, size_t from)
+    : source(nullptr), store(nullptr), edited(nullptr), next(tokens.size()), cursor(tokens.data() + from),
+      last(tokens.data() + tokens.size()), offset(0), status(Tokenizer::LEX_END_OF_FILE) {}
+
+TokenStream::TokenStream(const TokenStore& tokens, size_t from)
+    : source(nullptr), store(&tokens), edited(nullptr), next(from), offset(0), status(Tokenizer::LEX_STOPPED) {
+    buffer.reserve(BATCH + LOOKAHEAD);
+    cursor = last = buffer.data();
+}
+
+TokenStream::TokenStream(const IncrementalTokenizer& tokens, size_t from)
+    : source(nullptr), store(nullptr), edited(&tokens), next(from), offset(0), status(Tokenizer::LEX_STOPPED) {
+    buffer.reserve(BATCH + LOOKAHEAD);
+    cursor = last = buffer.data();
+}
+
+template <class Tokens>
+void TokenStream::copyBatch(const Tokens& tokens) {
+    size_t end = min(tokens.size(), next + BATCH);
+    for (; next < end; next++) {
+        buffer.push_back(tokens[next]);
+    }
+    if (next == tokens.size()) {
+        status = Tokenizer::LEX_END_OF_FILE;
+    }
+}
+
+const Token& TokenStream::refill(size_t ahead) {
+    static const Token endOfInput(END_OF_FILE, NO_OFFSET, 0);
+
+    while (cursor + ahead >= last) {
+        if (status != Tokenizer::LEX_STOPPED) {
+            if (status >= Tokenizer::LEX_UNTERMINATED_COMMENT) {
+                Tokenizer::reportError(status, input, offset);
+            }
+            return endOfInput;
+        }
 
-        if (c == '\n') {
-            line++;
-            column = 1;
+        // Drop what has been consumed and fetch the next batch after the rest
+        buffer.erase(buffer.begin(), buffer.begin() + (cursor - buffer.data()));
+        if (store) {
+            copyBatch(*store);
+        } else if (edited) {
+            copyBatch(*edited);
         } else {
-            column++;
+            lexBatch();
         }
+        cursor = buffer.data();
+        last = cursor + buffer.size();
     }
+    return cursor[ahead];
+}
 
-    return tokens;
-}
\ No newline at end of file
+// Of a source still being read, only the whole lines that have arrived are
+// lexed: the lexer's limit is the start of the line still arriving. A comment
+// or string left open there is lexed again from its start, once the bytes
+// after that start have at least doubled, so a long one is rescanned only a
+// few times.
+void TokenStream::lexBatch() {
+    for (;;) {
+        size_t limit = SIZE_MAX;
+        if (source) {
+            input = source->view();
+            if (!source->complete()) {
+                size_t newline = input.substr(offset).rfind('\n');
+                limit = newline == string_view::npos ? offset : offset + newline + 1;
+            }
+        }
+        size_t before = buffer.size();
+        Tokenizer::LexResult r = Tokenizer::lex(input, offset, vector<size_t>(), before + BATCH, symbols, buffer,
+                                                nullptr, limit);
+        if (r.end != limit || r.status < Tokenizer::LEX_STOPPED || r.status > Tokenizer::LEX_STOPPED_IN_STRING) {
+            status = r.status;
+            offset = r.end;
+            return;
+        }
+
+        status = Tokenizer::LEX_STOPPED;
+        offset = r.status == Tokenizer::LEX_STOPPED ? r.end : r.start;
+        if (buffer.size() > before) {
+            return;
+        }
+        size_t pending = input.size() - offset;
+        while (source->readMore() && source->size() - offset < 2 * pending) {
+        }
+    }
+}
@@ -1,12 +1,16 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
+#include "Interner.h"
+#include "LineTable.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
 
-enum TokenType
+enum TokenType : uint8_t
 {
     L_PAREN,
     R_PAREN,
@@ -39,45 +43,270 @@ enum TokenType
     STRING,
     INTEGER,
     IDENTIFIER,
+    KEYWORD_INT,
+    KEYWORD_CHAR,
+    KEYWORD_VOID,
+    KEYWORD_BOOL,
+    KEYWORD_FUNCTION,
+    KEYWORD_PROCEDURE,
+    KEYWORD_IF,
+    KEYWORD_ELSE,
+    KEYWORD_WHILE,
+    KEYWORD_FOR,
+    KEYWORD_RETURN,
+    KEYWORD_PRINTF,
+    KEYWORD_TRUE,
+    KEYWORD_FALSE,
     WHITESPACE,
     NEWLINE,
     TOKEN_ERROR,
     END_OF_FILE
 };
 
+// Reserved words get their own kinds at lex time; anywhere a name is allowed
+// they are accepted like IDENTIFIER, so the parser can still report them by name.
+inline bool isKeyword(TokenType type)
+{
+    return type >= KEYWORD_INT && type <= KEYWORD_FALSE;
+}
+
+// A token is a span of the source buffer it was read from (12 bytes); its
+// spelling is only produced when someone asks for it, and its line comes from
+// a LineTable over the same buffer. Names, keywords, operators and literals
+// also carry their interned Symbol (a literal's also keys its decoded value
+// in the LiteralPool); other tokens leave it SYM_NONE.
 struct Token
 {
-    TokenType type;
-    string value;
-    int line;
-    int column;
+    TokenType type : 8;
+    uint32_t length : 24;
+    uint32_t offset;
+    Symbol symbol;
+
+    Token() = default;
+    Token(TokenType t, uint32_t off, uint32_t len, Symbol sym = SYM_NONE)
+        : type(t), length(len), offset(off), symbol(sym) {}
+
+    string_view text(string_view source) const
+    {
+        return string_view(source.data() + offset, length);
+    }
+
+    string value(string_view source) const
+    {
+        return string(text(source));
+    }
 };
 
-enum TokenizerState
+// Tokens kept column-wise: kinds in one dense byte array, and source spans
+// and symbols in arrays of their own. routineStarts(), which finds where
+// parseParallel() cuts a parse into runs, reads the kinds only: one byte
+// per token, 16 of them per compare.
+class TokenStore
 {
-    TOKENIZER_START,
-    TOKENIZER_IDENTIFIER,
-    TOKENIZER_INTEGER,
-    TOKENIZER_DOUBLE_STRING,
-    TOKENIZER_SINGLE_STRING,
-    TOKENIZER_LT,
-    TOKENIZER_GT,
-    TOKENIZER_EQUAL,
-    TOKENIZER_NOT,
-    TOKENIZER_AND,
-    TOKENIZER_OR,
-    TOKENIZER_HEX_ESCAPE
+public:
+    struct Span
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    size_t size() const { return types.size(); }
+    bool empty() const { return types.empty(); }
+
+    TokenType type(size_t k) const { return static_cast<TokenType>(types[k]); }
+    const Span& span(size_t k) const { return spans[k]; }
+    Symbol symbol(size_t k) const { return symbols[k]; }
+
+    // Token k reassembled
+    Token operator[](size_t k) const
+    {
+        return Token(type(k), spans[k].offset, spans[k].length, symbols[k]);
+    }
+
+    void push_back(const Token& tok)
+    {
+        types.push_back(tok.type);
+        spans.push_back({tok.offset, tok.length});
+        symbols.push_back(tok.symbol);
+    }
+
+    void reserve(size_t count);
+
+    // Appends other's tokens, from token from on, after these
+    void append(const TokenStore& other, size_t from = 0);
+
+    // Indices of the function and procedure keywords that sit outside any
+    // braces, i.e. the start of each top-level routine
+    vector<size_t> routineStarts() const;
+
+private:
+    vector<uint8_t> types;
+    vector<Span> spans;
+    vector<Symbol> symbols;
 };
 
 class Tokenizer
 {
 public:
-    static vector<Token> tokenize(const string &input);
+    // Returns the significant tokens only. WHITESPACE and NEWLINE tokens
+    // (including the line breaks inside comments) are appended to trivia,
+    // in source order, when the caller asks for them.
+    static vector<Token> tokenize(string_view input, vector<Token>* trivia = nullptr);
+
+    // Same tokens, trivia and errors as tokenize(), with the input cut into
+    // line ranges that are lexed on separate threads (0 means one per
+    // hardware thread). Small inputs run serially. Spellings interned for
+    // the first time get their symbols in whatever order the threads reach
+    // them, so those values can differ from tokenize()'s and between runs.
+    static vector<Token> tokenizeParallel(string_view input, unsigned threads = 0,
+                                          vector<Token>* trivia = nullptr);
+
+    // Same tokens as tokenizeParallel(), stored column-wise and without
+    // trivia, except that a lexical error is not reported: false is
+    // returned, and tokens holds some of the tokens before it
+    static bool tryTokenizeParallel(string_view input, TokenStore& tokens, unsigned threads = 0);
+
+    // Same tokens and errors as tokenize(), stored column-wise
+    static TokenStore tokenizeStore(string_view input, vector<Token>* trivia = nullptr);
+
+    // The keyword kind spelled by word, or IDENTIFIER if it is not reserved
+    static TokenType keywordType(string_view word);
 
 private:
+    friend class TokenStream;
+    friend class IncrementalTokenizer;
+
+    enum LexStatus {
+        LEX_END_OF_FILE,            // END_OF_FILE was emitted
+        LEX_NO_END_OF_FILE,         // input ended on a backslash inside a string
+        LEX_STOPPED,                // reached a stop offset or the token limit between tokens
+        LEX_STOPPED_IN_COMMENT,     // reached the limit inside a block comment
+        LEX_STOPPED_IN_STRING,      // reached the limit inside a string, after an escaped newline
+        LEX_UNTERMINATED_COMMENT,
+        LEX_UNTERMINATED_STRING,
+        LEX_TOKEN_TOO_LONG
+    };
+
+    struct LexResult {
+        LexStatus status;
+        size_t end;     // where lexing stopped, or where the error is
+        size_t start = 0;   // where the comment or string a limit fell inside began
+    };
+
+    // Lexes input from offset begin until the end of input, an error, the
+    // first of the sorted stop offsets that falls between two tokens, or
+    // tokens holding maxTokens entries. Between tokens the lexer keeps no
+    // state beyond the offset, so lexing can be resumed from any LEX_STOPPED
+    // result. Stops inside a comment or string are passed over; limit, which
+    // must start a line, is not, and ends lexing whatever the state there.
+    // Tokens go to anything with push_back(Token) and size(): a
+    // vector<Token> or a TokenStore.
+    template <class Sink>
+    static LexResult lex(string_view input, size_t begin, const vector<size_t>& stops,
+                         size_t maxTokens, Interner::Cache& symbols,
+                         Sink& tokens, vector<Token>* trivia, size_t limit = SIZE_MAX);
+
+    // Finds the "*/" that closes a block comment whose body continues at
+    // from, adding the newlines before it to trivia if kept: LEX_STOPPED
+    // just past it, LEX_STOPPED_IN_COMMENT at limit, or
+    // LEX_UNTERMINATED_COMMENT
+    static LexResult skipComment(string_view input, size_t from, size_t limit, vector<Token>* trivia);
+
+    // Finds the quote that closes a string whose body continues at from:
+    // LEX_STOPPED at the quote, LEX_STOPPED_IN_STRING at limit, or the
+    // error that ends the string first
+    static LexResult skipString(string_view input, size_t from, char quote, size_t limit);
+
+    // tokenizeParallel() up to the error it finds first, if any, which is
+    // returned rather than reported; tokens (a vector<Token> or a
+    // TokenStore) must be empty
+    template <class Sink>
+    static LexResult lexParallel(string_view input, unsigned threads, Sink& tokens,
+                                 vector<Token>* trivia);
+
+    // Longest spelling a Token can describe (its length field is 24 bits)
+    static constexpr uint32_t MAX_TOKEN_LENGTH = (1u << 24) - 1;
+
+    // Reports the error found at offset in input, with its line
+    [[noreturn]] static void reportError(LexStatus status, string_view input, size_t offset);
+
     static bool isHexDigit(char c);
-    static bool isLetterOrUnderscore(char c);
-    static bool isLetterDigitOrUnderscore(char c);
+    static bool isDigit(char c);
+};
+
+class IncrementalTokenizer;
+class SourceBuffer;
+
+// Hands significant tokens to a single consumer on demand. Over raw input it
+// lexes a small batch whenever the consumer runs out and drops the tokens it
+// has passed, so memory stays bounded however long the file is; a lexical
+// error is reported once the consumer reaches it. Over a SourceBuffer that is
+// still being read, it lexes the whole lines that have arrived and reads more
+// when those run out. It can also walk a vector that was lexed up front,
+// without copying it, or a TokenStore or an IncrementalTokenizer, whose tokens
+// are copied out a batch at a time.
+class TokenStream
+{
+public:
+    // How far past the current token peek() may look
+    static const size_t LOOKAHEAD = 1;
+
+    // Over raw input, lexed from byte from, which must lie between two tokens
+    explicit TokenStream(string_view input, size_t from = 0);
+    // Over a source as it is read, which must outlive the stream
+    explicit TokenStream(SourceBuffer& source);
+    // Over tokens lexed up front, starting at token from
+    explicit TokenStream(const vector<Token>& tokens, size_t from = 0);
+    explicit TokenStream(const TokenStore& tokens, size_t from = 0);
+    explicit TokenStream(const IncrementalTokenizer& tokens, size_t from = 0);
+
+    TokenStream(const TokenStream&) = delete;
+    TokenStream& operator=(const TokenStream&) = delete;
+
+    // The token ahead places past the current one, or an END_OF_FILE token at
+    // NO_OFFSET once the input is used up
+    const Token& peek(size_t ahead = 0)
+    {
+        return cursor + ahead < last ? cursor[ahead] : refill(ahead);
+    }
+
+    // Consumes the current token; the reference stays valid until the next
+    // peek() or advance()
+    const Token& advance()
+    {
+        const Token& tok = peek();
+        if (cursor < last) {
+            cursor++;
+        }
+        return tok;
+    }
+
+    // Index of the current token in the tokens being walked
+    size_t position() const { return next - (last - cursor); }
+
+private:
+    static const size_t BATCH = 256;
+
+    string_view input;
+    SourceBuffer* source;   // read further as input runs out, or null
+    const TokenStore* store;
+    const IncrementalTokenizer* edited;
+    size_t next;        // the next token to copy out of store or edited (a vector's size)
+    vector<Token> buffer;
+    const Token* cursor;
+    const Token* last;
+    size_t offset;
+    Tokenizer::LexStatus status;
+    Interner::Cache symbols;
+
+    const Token& refill(size_t ahead);
+
+    // Lexes the next batch of raw input onto buffer
+    void lexBatch();
+
+    // Appends the next batch of a TokenStore or IncrementalTokenizer to buffer
+    template <class Tokens>
+    void copyBatch(const Tokens& tokens);
 };
 
 #endif
\ No newline at end of file
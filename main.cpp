@@ -1,11 +1,10 @@
-#include "CommentRemover.h"
+#include "SourceBuffer.h"
+#include "Encoding.h"
 #include "Tokenizer.h"
 #include "CSTParser.h"
 #include "SymbolTableBuilder.h"
 #include "ASTBuilder.h" // <-- Added for AST generation
 #include <iostream>
-#include <fstream>
-#include <sstream>
 
 using namespace std;
 
@@ -21,34 +20,62 @@ int main(int argc, char *argv[])
         filename = "file1.txt";
     }
 
-    // Read input file
-    ifstream inFile(filename);
-    if (!inFile)
+    // Read input file ("-" reads stdin); regular files are mapped, not copied
+    SourceBuffer source;
+    if (!source.open(filename))
     {
         cerr << "Can't open file" << endl;
         return 1;
     }
 
-    stringstream buffer;
-    buffer << inFile.rdbuf();
-    string inputContent = buffer.str();
-    inFile.close();
-
-    // Assignment 1: Remove comments
-    string cleanedContent = CommentRemover::removeComments(inputContent);
-
-    // Assignment 2: Tokenize
-    vector<Token> tokens = Tokenizer::tokenize(cleanedContent);
+    // Reject malformed input in one sweep, before any stage reads it byte by
+    // byte. Input that is still being read (a pipe or stdin) is checked a line
+    // at a time as it arrives instead.
+    if (source.complete())
+    {
+        Encoding::validate(source.view());
+    }
 
-    // Assignment 3: Build CST
-    CSTParser parser(tokens);
-    TreeNode *cst = parser.parse();
+    // Assignments 1-3 and 5: Remove comments, tokenize and parse. Each
+    // top-level unit's CST is lowered to the AST and its declarations
+    // recorded once it is parsed.
+    ParseResult tree;
+    vector<Declared> declarations;
+    ASTNode *ast = new ASTNode(SYM_PROGRAM);
+    ASTNode **tail = &ast->leftChild;
+    auto lower = [&](TreeRef node)
+    {
+        SymbolTableBuilder::collectDeclarations(node, declarations);
+        *tail = ASTBuilder::buildTopLevel(node);
+        tail = &(*tail)->rightSibling;
+    };
+    if (source.complete() && CSTParser::parallelRuns(source.size()) > 1)
+    {
+        // Large sources are lexed and parsed on every core, holding the whole CST
+        TreeRef program = CSTParser::parseParallel(source.view(), tree);
+        for (TreeRef node = program->leftChild; node; node = node->rightSibling)
+        {
+            lower(node);
+        }
+    }
+    else
+    {
+        // Otherwise tokens are lexed as the parser reaches them and dropped
+        // after, and only one unit's CST is held. A source still being read
+        // is parsed as its lines arrive.
+        CSTParser parser(source);
+        while (TreeRef node = parser.parseUnit(tree))
+        {
+            lower(node);
+        }
+    }
 
     // Assignment 4: Build Symbol Table
-    SymbolTable table;
+    LineTable lines(source.view());
+    SymbolTable table(lines);
     vector<ParameterList> parameterLists;
     int scope = 0;
-    SymbolTableBuilder::buildSymbolTable(cst, table, scope, parameterLists);
+    SymbolTableBuilder::buildSymbolTable(declarations, table, scope, parameterLists);
 
     // Print symbol table
     // table.print();
@@ -61,7 +88,6 @@ int main(int argc, char *argv[])
     cout << "BUILDING ABSTRACT SYNTAX TREE (AST)" << endl;
     cout << "====================================" << endl;
 
-    ASTNode *ast = ASTBuilder::build(cst);
     ASTBuilder::printExpected(ast, cout);
     ASTBuilder::free(ast);
 
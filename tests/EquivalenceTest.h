@@ -0,0 +1,81 @@
+#ifndef EQUIVALENCETEST_H
+#define EQUIVALENCETEST_H
+
+#include "CSTParser.h"
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// What a piece of work did in a child process: its exit status and what it
+// printed to standard output and standard error, interleaved
+struct Outcome {
+    int status;
+    string output;
+
+    bool operator==(const Outcome& other) const { return status == other.status && output == other.output; }
+    bool operator!=(const Outcome& other) const { return !(*this == other); }
+};
+
+// Runs work in a child process, so the equivalence tests can compare paths
+// that report an error by exiting. work returns what the child prints to
+// standard output once it is done.
+inline Outcome isolated(const function<string()>& work)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(2);
+    }
+    cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        cout << work();
+        cout.flush();
+        _exit(0);
+    }
+    close(fds[1]);
+    Outcome outcome{0, string()};
+    char chunk[4096];
+    for (ssize_t n; (n = read(fds[0], chunk, sizeof(chunk))) > 0;) {
+        outcome.output.append(chunk, static_cast<size_t>(n));
+    }
+    close(fds[0]);
+    int status;
+    waitpid(child, &status, 0);
+    outcome.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return outcome;
+}
+
+// A tree in preorder: depth, spelling and source offset of every node
+inline string dump(TreeRef root)
+{
+    ostringstream out;
+    vector<pair<TreeRef, int>> pending;
+    if (root) {
+        pending.push_back({root, 0});
+    }
+    while (!pending.empty()) {
+        auto [node, depth] = pending.back();
+        pending.pop_back();
+        out << depth << ' ' << Interner::spelling(node->value) << ' ' << node->offset << '\n';
+        if (node->rightSibling) {
+            pending.push_back({node->rightSibling, depth});
+        }
+        if (node->leftChild) {
+            pending.push_back({node->leftChild, depth + 1});
+        }
+    }
+    return out.str();
+}
+
+#endif
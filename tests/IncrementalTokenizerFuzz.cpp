@@ -0,0 +1,86 @@
+// Edits random programs at random places, through an IncrementalTokenizer,
+// and checks after every edit that its text and tokens are what lexing the
+// edited text from scratch gives, and that it has a lexical error exactly
+// when that has one.
+//
+// usage: IncrementalTokenizerFuzz [programs] [edits per program] [first seed]
+
+#include "IncrementalTokenizer.h"
+#include "ProgramGenerator.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// Text typed in: what opens or closes comments and strings, and what joins
+// or splits tokens
+const vector<string> snippets = {"x", "1", "-", "/", "*", "/*", "*/", "//", "\n", " ", "\"", "'", "\\", "abc",
+                                 "int ", "if", "(", ")", "{", "}", ";", "=", "==", "&&", "\\x4", "9"};
+
+// Compares the edited tokenizer with one that lexed text from scratch
+bool sameTokens(IncrementalTokenizer& edited, const string& text, string& why)
+{
+    if (edited.text() != text) {
+        why = "text differs";
+        return false;
+    }
+    IncrementalTokenizer full(text);
+    if (edited.hasError() != full.hasError()) {
+        why = full.hasError() ? "error missed by the edit" : "error found only by the edit";
+        return false;
+    }
+    if (full.hasError()) {
+        return true;
+    }
+    if (edited.size() != full.size()) {
+        why = to_string(edited.size()) + " tokens instead of " + to_string(full.size());
+        return false;
+    }
+    for (size_t k = 0; k < full.size(); k++) {
+        Token a = edited[k];
+        Token b = full[k];
+        if (a.type != b.type || a.offset != b.offset || a.length != b.length || a.symbol != b.symbol) {
+            why = "token " + to_string(k) + " differs";
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int programs = argc > 1 ? atoi(argv[1]) : 200;
+    int edits = argc > 2 ? atoi(argv[2]) : 100;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(atoi(argv[3])) : 1;
+
+    int failed = 0;
+    for (int p = 0; p < programs; p++, seed++) {
+        ProgramGenerator gen(seed);
+        string text = gen.program(8);
+        IncrementalTokenizer edited(text);
+        for (int e = 0; e < edits; e++) {
+            size_t offset = static_cast<size_t>(gen.pick(0, static_cast<int>(text.size())));
+            size_t length = min<size_t>(text.size() - offset, static_cast<size_t>(gen.pick(0, 3)));
+            string replacement;
+            for (int k = gen.pick(0, 2); k > 0; k--) {
+                replacement += gen.one(snippets);
+            }
+            text.replace(offset, length, replacement);
+            edited.edit(offset, length, replacement);
+
+            string why;
+            if (!sameTokens(edited, text, why)) {
+                cout << "FAIL: seed " << seed << ", edit " << e << ": " << why << endl;
+                failed++;
+                break;
+            }
+        }
+    }
+
+    cout << programs - failed << " of " << programs << " edited programs lexed as from scratch" << endl;
+    return failed == 0 ? 0 : 1;
+}
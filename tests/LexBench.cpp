@@ -0,0 +1,54 @@
+// Times Tokenizer::tokenize() against Tokenizer::tokenizeParallel() on a large
+// generated program (or a file), on each thread count up to the one given.
+//
+// usage: LexBench [file] [threads]
+
+#include "ProgramGenerator.h"
+#include "Tokenizer.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    string text;
+    if (argc > 1) {
+        ifstream in(argv[1], ios::binary);
+        ostringstream read;
+        read << in.rdbuf();
+        text = read.str();
+    } else {
+        ProgramGenerator gen(1);
+        while (text.size() < (16u << 20)) {
+            text += gen.cleanProgram(12);
+        }
+    }
+    unsigned threads = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : max(4u, thread::hardware_concurrency());
+
+    auto start = chrono::steady_clock::now();
+    size_t count = Tokenizer::tokenize(text).size();
+    double serialTime = secondsSince(start);
+
+    cout << text.size() << " bytes, " << count << " tokens" << endl;
+    cout << "tokenize:            " << serialTime * 1e3 << " ms" << endl;
+    for (unsigned t = 2; t <= threads; t++) {
+        start = chrono::steady_clock::now();
+        Tokenizer::tokenizeParallel(text, t);
+        cout << "tokenizeParallel(" << t << "): " << secondsSince(start) * 1e3 << " ms" << endl;
+    }
+    return 0;
+}
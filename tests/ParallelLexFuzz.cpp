@@ -0,0 +1,168 @@
+// Lexes random texts large enough to be sharded, on several threads and on
+// one, and checks that the tokens, the trivia and the error reported are the
+// same. Shards start at the first newline past an even split of the text, so
+// the lines about each of those are rewritten to hold a comment, a string or
+// an escaped newline that runs across it, or one that is left open; now and
+// then a comment covers a whole shard instead. Lexing into a TokenStore with
+// tryTokenizeParallel() is checked the same way.
+//
+// usage: ParallelLexFuzz [texts] [first seed]
+
+#include "EquivalenceTest.h"
+#include "ProgramGenerator.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// What opens a construct at the end of one line and closes it at the start
+// of the next: pairs that lex across the newline, and pairs that do not
+const vector<pair<string, string>> spanning = {{"/*", "*/"}, {"\"\\", "\""}, {"'\\", "'"}, {"//", ""},
+                                               {"/* a", "b */ x"}, {"\"s\\\\\\", "t\""}};
+const vector<pair<string, string>> breaking = {{"\"", "\""}, {"/*", ""}, {"", "*/"}, {"'", "'"},
+                                               {"\"\\\\", "\""}, {"/", "*"}};
+
+// The tokens and trivia a lexer gave, as bytes to compare. Symbols are
+// numbered in the order spellings are first interned, which differs between
+// one thread and several, so each is written as its spelling.
+string serialized(const vector<Token>& tokens, const vector<Token>& trivia)
+{
+    string out;
+    for (const vector<Token>* list : {&tokens, &trivia}) {
+        out += to_string(list->size()) + '\n';
+        for (const Token& tok : *list) {
+            uint32_t fields[] = {static_cast<uint32_t>(tok.type), tok.offset, tok.length};
+            out.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+            out += Interner::spelling(tok.symbol);
+            out += '\0';
+        }
+    }
+    return out;
+}
+
+// The tokens in a TokenStore, in order
+vector<Token> unpack(const TokenStore& store)
+{
+    vector<Token> tokens;
+    for (size_t k = 0; k < store.size(); k++) {
+        tokens.push_back(store[k]);
+    }
+    return tokens;
+}
+
+// Rewrites the line ending at the newline a shard starts after, and the
+// line after it, so that they hold a construct running across the newline.
+// Lines too short for it take in their neighbours.
+void straddle(ProgramGenerator& gen, string& text, size_t split, bool wellFormed)
+{
+    size_t newline = text.find('\n', split);
+    if (newline == string::npos) {
+        return;
+    }
+    const pair<string, string>& hazard = gen.one(wellFormed || gen.chance(0.5) ? spanning : breaking);
+    size_t begin = newline;
+    while (begin > 0 && (newline - begin < hazard.first.size() || text[begin - 1] != '\n')) {
+        begin--;
+    }
+    size_t end = newline + 1;
+    while (end < text.size() && (end - newline - 1 < hazard.second.size() || text[end] != '\n')) {
+        end++;
+    }
+    if (newline - begin < hazard.first.size() || end - newline - 1 < hazard.second.size()) {
+        return;
+    }
+    string before(newline - begin - hazard.first.size(), ' ');
+    string after(end - newline - 1 - hazard.second.size(), ' ');
+    text.replace(begin, end - begin, before + hazard.first + "\n" + hazard.second + after);
+}
+
+// Opens a comment at the end of the line about from and closes it at the
+// start of the line after the one about to, so that the shard between the
+// splits there begins and ends inside it
+void cover(string& text, size_t from, size_t to)
+{
+    size_t open = text.find('\n', from);
+    size_t close = text.find('\n', to);
+    if (open == string::npos || close == string::npos || open < 2 || close + 3 > text.size()) {
+        return;
+    }
+    text.replace(open - 2, 2, "/*");
+    text.replace(close + 1, 2, "*/");
+}
+
+// Generated programs, repeated to just over shards times the size below
+// which lexing is not sharded, with hazards at some of the splits. Well-formed
+// texts are made of clean programs, whose numbers are all in range.
+string shardedText(ProgramGenerator& gen, unsigned shards)
+{
+    bool wellFormed = gen.chance(0.6);
+    string pieces;
+    while (pieces.size() < (64u << 10)) {
+        pieces += wellFormed ? gen.cleanProgram(8) : gen.program(8);
+    }
+    string text;
+    while (text.size() < shards * (1u << 20) + 4096) {
+        text += pieces;
+    }
+
+    for (unsigned k = 1; k < shards; k++) {
+        // Splits left alone are entered between tokens
+        if (k + 1 < shards && gen.chance(0.2)) {
+            cover(text, text.size() / shards * k, text.size() / shards * (k + 1));
+            k++;
+        } else if (gen.chance(0.6)) {
+            straddle(gen, text, text.size() / shards * k, wellFormed);
+        }
+    }
+    return text;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int texts = argc > 1 ? atoi(argv[1]) : 30;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+
+    int failed = 0;
+    int lexed = 0;
+    for (int t = 0; t < texts; t++, seed++) {
+        ProgramGenerator gen(seed);
+        unsigned threads = static_cast<unsigned>(gen.pick(2, 4));
+        string text = shardedText(gen, threads);
+
+        // Errors exit the process, so each lexer runs in a child of its own
+        Outcome serial = isolated([&]() {
+            vector<Token> trivia;
+            vector<Token> tokens = Tokenizer::tokenize(text, &trivia);
+            return serialized(tokens, trivia);
+        });
+        Outcome parallel = isolated([&]() {
+            vector<Token> trivia;
+            vector<Token> tokens = Tokenizer::tokenizeParallel(text, threads, &trivia);
+            return serialized(tokens, trivia);
+        });
+        if (serial.status == 0) {
+            lexed++;
+        }
+
+        // tryTokenizeParallel() reports an error instead of exiting, so it
+        // runs here, and into a TokenStore
+        TokenStore serialStore;
+        TokenStore parallelStore;
+        bool stored = Tokenizer::tryTokenizeParallel(text, serialStore, 1);
+        bool same = Tokenizer::tryTokenizeParallel(text, parallelStore, threads) == stored &&
+                    stored == (serial.status == 0) &&
+                    (!stored || serialized(unpack(parallelStore), {}) == serialized(unpack(serialStore), {}));
+        if (parallel != serial || !same) {
+            cout << "FAIL: seed " << seed << ", " << threads << " threads" << endl;
+            failed++;
+        }
+    }
+
+    cout << texts - failed << " of " << texts << " texts lexed on several threads as on one (" << lexed
+         << " without error)" << endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+// Parses random texts large enough to be cut into runs with parseParallel(),
+// on two to four threads, and checks that the tree, or the error reported, is
+// what parsing them serially gives. Texts are generated programs laid end to
+// end, and most have tokens dropped in about where the runs are cut: braces
+// and routine heads that move where units start, stray tokens that make
+// syntax errors in one run or several, and lexical errors.
+//
+// usage: ParallelParseFuzz [texts] [first seed]
+
+#include "EquivalenceTest.h"
+#include "ProgramGenerator.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// What is dropped into a text: pieces that keep it parsing, then pieces
+// that break its syntax, then pieces that do not lex
+const vector<string> harmless = {"\n", " ", "int q1;\n", "procedure r (void) { }\n", "// }\n", "/* } */"};
+const vector<string> breaking = {"}", "{", "function", "procedure", "function int", ";", ")", "else", "int",
+                                 "(", "}\nprocedure p (void) {\n"};
+const vector<string> unlexable = {"\"", "/*", "@", "'ab'"};
+
+// Generated programs, end to end, to a little over the size parseParallel()
+// cuts into runs threads ways
+string runText(ProgramGenerator& gen, unsigned threads, bool clean)
+{
+    string text;
+    while (text.size() < threads * (256u << 10) + 4096) {
+        text += clean ? gen.cleanProgram(8) : gen.program(8);
+    }
+    return text;
+}
+
+// Drops piece in at the start of a line near byte at
+void insertNear(ProgramGenerator& gen, string& text, size_t at, const string& piece)
+{
+    at = min(text.size(), at + static_cast<size_t>(gen.pick(0, 2000)));
+    size_t line = text.rfind('\n', at);
+    text.insert(line == string::npos ? 0 : line + 1, piece);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int texts = argc > 1 ? atoi(argv[1]) : 40;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+
+    int failed = 0;
+    int parsed = 0;
+    for (int t = 0; t < texts; t++, seed++) {
+        ProgramGenerator gen(seed);
+        unsigned threads = static_cast<unsigned>(gen.pick(2, 4));
+        double kind = gen.real();
+        string text = runText(gen, threads, kind < 0.7);
+        for (unsigned k = 1; k < threads; k++) {
+            size_t split = text.size() / threads * k;
+            if (kind < 0.4) {
+                insertNear(gen, text, split, gen.one(harmless));
+            } else if (kind < 0.85) {
+                insertNear(gen, text, split, gen.one(gen.chance(0.5) ? harmless : breaking));
+            } else if (gen.chance(0.5)) {
+                insertNear(gen, text, split, gen.one(unlexable));
+            }
+        }
+
+        Outcome serial = isolated([&]() {
+            ParseResult tree;
+            return dump(CSTParser(text).parse(tree));
+        });
+        Outcome parallel = isolated([&]() {
+            ParseResult tree;
+            return dump(CSTParser::parseParallel(text, tree, threads));
+        });
+        if (serial.status == 0) {
+            parsed++;
+        }
+        if (parallel != serial) {
+            cout << "FAIL: seed " << seed << ", " << threads << " threads" << endl;
+            failed++;
+        }
+    }
+
+    cout << texts - failed << " of " << texts << " texts parsed on several threads as on one (" << parsed
+         << " without error)" << endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+// Times parsing a large generated program and a generated kernel of long
+// expressions (or a file), streamed from the source, from tokens lexed up
+// front into a vector and into a TokenStore, a unit at a time and on four
+// threads, and reports the most memory each way holds. Each is run in a child
+// process of its own, whose peak resident size is what the kernel reports for
+// it.
+//
+// usage: ParseBench [file]
+
+#include "CSTParser.h"
+#include "ProgramGenerator.h"
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Runs work in a child process; prints how long it took and its peak size
+void measure(const string& name, const function<void()>& work)
+{
+    cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        auto start = chrono::steady_clock::now();
+        work();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << name << seconds * 1e3 << " ms";
+        cout.flush();
+        _exit(0);
+    }
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    cout << ", " << usage.ru_maxrss / 1024 << " MB peak" << endl;
+}
+
+void bench(const string& text)
+{
+    cout << text.size() << " bytes" << endl;
+    measure("streamed:         ", [&]() { CSTParser(text).parse(); });
+    measure("vector of tokens: ", [&]() {
+        vector<Token> tokens = Tokenizer::tokenize(text);
+        CSTParser(tokens, text).parse();
+    });
+    measure("TokenStore:       ", [&]() {
+        TokenStore store = Tokenizer::tokenizeStore(text);
+        CSTParser(store, text).parse();
+    });
+    measure("unit at a time:   ", [&]() {
+        CSTParser parser(text);
+        ParseResult unit;
+        while (parser.parseUnit(unit)) {
+        }
+    });
+    measure("parseParallel(4): ", [&]() {
+        ParseResult tree;
+        CSTParser::parseParallel(text, tree, 4);
+    });
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1) {
+        ifstream in(argv[1], ios::binary);
+        ostringstream read;
+        read << in.rdbuf();
+        bench(read.str());
+        return 0;
+    }
+
+    ProgramGenerator gen(1);
+    string text;
+    while (text.size() < (16u << 20)) {
+        text += gen.cleanProgram(12);
+    }
+    cout << "programs: ";
+    bench(text);
+
+    text.clear();
+    while (text.size() < (16u << 20)) {
+        text += "procedure kernel (void)\n{\n";
+        for (int k = 0; k < 50; k++) {
+            text += "  x = " + gen.expression(6) + ";\n";
+        }
+        text += "}\n";
+    }
+    cout << "expressions: ";
+    bench(text);
+    return 0;
+}
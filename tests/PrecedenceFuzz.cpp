@@ -0,0 +1,161 @@
+// Builds random expression trees, prints each with only the parentheses its
+// shape needs under the language's precedence and left associativity (and
+// now and then a redundant pair), parses it as a return value, and checks
+// that the CST has the BinaryOp, UnaryOp and ParenExpr nodes of the tree it
+// was printed from. The precedence levels below are the language's, written
+// out again rather than read from the parser's table.
+//
+// usage: PrecedenceFuzz [expressions] [first seed]
+
+#include "CSTParser.h"
+#include "ProgramGenerator.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// Binary operators, loosest first
+const vector<vector<string>> levels = {{"||"}, {"&&"}, {"==", "!="}, {"<", ">", "<=", ">="}, {"+", "-"},
+                                       {"*", "/", "%"}};
+
+// Text to parse, and the shape its CST must have: (L op R) for a BinaryOp,
+// (op X) for a UnaryOp, [X] for a ParenExpr, f{A,B} for a call and a<I> for
+// an array access
+struct Printed {
+    string text;
+    string shape;
+    int precedence;     // of the operator at the top, or one past the tightest
+};
+
+Printed parenthesized(const Printed& inner)
+{
+    return {"(" + inner.text + ")", "[" + inner.shape + "]", static_cast<int>(levels.size()) + 1};
+}
+
+Printed expression(ProgramGenerator& gen, int depth)
+{
+    static const vector<string> leaves = {"x", "y", "n", "3", "0", "TRUE"};
+    const int tightest = static_cast<int>(levels.size()) + 1;
+    if (depth <= 0 || gen.chance(0.15)) {
+        string leaf = gen.one(leaves);
+        return {leaf, leaf, tightest};
+    }
+
+    double k = gen.real();
+    if (k < 0.15) {
+        string op = gen.chance(0.5) ? "-" : "!";
+        Printed operand = expression(gen, depth - 1);
+        if (operand.precedence < tightest) {
+            operand = parenthesized(operand);
+        }
+        return {op + " " + operand.text, "(" + op + " " + operand.shape + ")", tightest};
+    }
+    if (k < 0.2) {
+        return parenthesized(expression(gen, depth - 1));
+    }
+    if (k < 0.25) {
+        Printed index = expression(gen, depth - 1);
+        return {"a[" + index.text + "]", "a<" + index.shape + ">", tightest};
+    }
+    if (k < 0.3) {
+        Printed first = expression(gen, depth - 1);
+        Printed second = expression(gen, depth - 2);
+        return {"f(" + first.text + ", " + second.text + ")", "f{" + first.shape + "," + second.shape + "}",
+                tightest};
+    }
+
+    int level = gen.pick(0, static_cast<int>(levels.size()) - 1);
+    const string& op = gen.one(levels[level]);
+    int precedence = level + 1;
+    Printed left = expression(gen, depth - 1);
+    Printed right = expression(gen, depth - 1);
+    // Operators associate to the left, so a right operand at the same level
+    // needs parentheses and a left one does not
+    if (left.precedence < precedence) {
+        left = parenthesized(left);
+    }
+    if (right.precedence <= precedence) {
+        right = parenthesized(right);
+    }
+    return {left.text + " " + op + " " + right.text, "(" + left.shape + " " + op + " " + right.shape + ")",
+            precedence};
+}
+
+// The shape of the CST below node, written as Printed::shape is
+string shape(TreeRef node)
+{
+    string spelling(Interner::spelling(node->value));
+    switch (node->value) {
+    case SYM_BINARY_OP: {
+        TreeRef op = node->leftChild->rightSibling;
+        return "(" + shape(node->leftChild) + " " + string(Interner::spelling(op->value)) + " " +
+               shape(op->rightSibling) + ")";
+    }
+    case SYM_UNARY_OP:
+        return "(" + string(Interner::spelling(node->leftChild->value)) + " " +
+               shape(node->leftChild->rightSibling) + ")";
+    case SYM_PAREN_EXPR:
+        return "[" + shape(node->leftChild->rightSibling) + "]";
+    case SYM_ARRAY_ACCESS:
+        return string(Interner::spelling(node->leftChild->value)) + "<" +
+               shape(node->leftChild->rightSibling->rightSibling) + ">";
+    case SYM_FUNCTION_CALL: {
+        string out = string(Interner::spelling(node->leftChild->value)) + "{";
+        string separator;
+        for (TreeRef arg = node->leftChild->rightSibling->rightSibling; arg; arg = arg->rightSibling) {
+            string piece(Interner::spelling(arg->value));
+            if (piece != "," && piece != ")") {
+                out += separator + shape(arg);
+                separator = ",";
+            }
+        }
+        return out + "}";
+    }
+    default:
+        return spelling;
+    }
+}
+
+// The expression of the first return statement under root
+TreeRef returned(TreeRef root)
+{
+    vector<TreeRef> pending = {root};
+    while (!pending.empty()) {
+        TreeRef node = pending.back();
+        pending.pop_back();
+        if (node->value == SYM_RETURN_STMT) {
+            return node->leftChild->rightSibling;
+        }
+        for (TreeRef child = node->leftChild; child; child = child->rightSibling) {
+            pending.push_back(child);
+        }
+    }
+    return TreeRef();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int expressions = argc > 1 ? atoi(argv[1]) : 3000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+
+    int failed = 0;
+    for (int e = 0; e < expressions; e++, seed++) {
+        ProgramGenerator gen(seed);
+        Printed printed = expression(gen, gen.pick(1, 8));
+        string text = "function int f (void) { return " + printed.text + "; }\n";
+        string parsed = shape(returned(CSTParser(text).parse()));
+        if (parsed != printed.shape) {
+            cout << "FAIL: seed " << seed << ": " << printed.text << endl;
+            cout << "  expected " << printed.shape << endl << "  parsed   " << parsed << endl;
+            failed++;
+        }
+    }
+
+    cout << expressions - failed << " of " << expressions << " expressions parsed with the precedence they were "
+         << "printed with" << endl;
+    return failed == 0 ? 0 : 1;
+}
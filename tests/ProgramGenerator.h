@@ -0,0 +1,169 @@
+#ifndef PROGRAMGENERATOR_H
+#define PROGRAMGENERATOR_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Writes random programs for the equivalence tests: routines and global
+// declarations with nested statements and expressions of every operator,
+// literal and escape the language has. About half of them are clean; the
+// rest reuse names (so the symbol table has errors to report) or have one
+// word replaced by a stray token (so the parser does).
+class ProgramGenerator
+{
+public:
+    explicit ProgramGenerator(unsigned seed) : rng(seed), clean(true), fresh(0) {}
+
+    // A program of up to units routines and global declarations
+    string program(int units = 5) { return write(units, chance(0.6)); }
+
+    // One that parses, and declares every name once
+    string cleanProgram(int units = 5) { return write(units, true); }
+
+    // An expression nested about depth deep
+    string expression(int depth)
+    {
+        static const vector<string> leaves = {"x", "y", "a", "n", "TRUE", "FALSE", "3", "0", "a[1]", "f(x, 2)",
+                                              "'c'", "'\\n'", "\"s %d\"", "\"q\\\"\"", "g()"};
+        static const vector<string> ops = {"||", "&&", "==", "!=", "<", ">", "<=", ">=", "+", "-", "*", "/", "%"};
+        if (depth <= 0 || chance(0.25)) {
+            return one(leaves);
+        }
+        double k = real();
+        if (k < 0.15) {
+            return (chance(0.5) ? "!" : "-") + expression(depth - 1);
+        }
+        if (k < 0.25) {
+            return "(" + expression(depth - 1) + ")";
+        }
+        if (k < 0.33) {
+            return "a[" + expression(depth - 1) + "]";
+        }
+        if (k < 0.42) {
+            return "f(" + expression(depth - 1) + ", " + expression(depth - 2) + ")";
+        }
+        return expression(depth - 1) + " " + one(ops) + " " + expression(depth - 1);
+    }
+
+    int pick(int low, int high) { return uniform_int_distribution<int>(low, high)(rng); }
+    double real() { return uniform_real_distribution<double>(0, 1)(rng); }
+    bool chance(double p) { return real() < p; }
+
+    template <class T>
+    const T& one(const vector<T>& items) { return items[pick(0, static_cast<int>(items.size()) - 1)]; }
+
+private:
+    mt19937 rng;
+    bool clean;     // every name declared once, every array size valid
+    int fresh;      // for the next clean name
+
+    string write(int units, bool cleanOnly)
+    {
+        clean = cleanOnly;
+        string out;
+        for (int k = pick(1, units); k > 0; k--) {
+            out += chance(0.3) ? declaration() : routine();
+            out += '\n';
+        }
+        if (!clean && chance(0.4)) {
+            damage(out);
+        }
+        return out;
+    }
+
+    string declaration()
+    {
+        static const vector<string> names = {"x", "y", "z", "a", "b", "n", "count", "w", "v"};
+        static const vector<string> sizes = {"4", "10", "1"};
+        static const vector<string> badSizes = {"4", "10", "1", "x", "99999999999", "0x10"};
+        string out = one(types()) + " ";
+        for (int k = pick(1, 3); k > 0; k--) {
+            out += clean ? "v" + to_string(fresh++) : one(names);
+            if (chance(0.3)) {
+                out += "[" + one(clean ? sizes : badSizes) + "]";
+            }
+            out += k > 1 ? ", " : ";";
+        }
+        return out;
+    }
+
+    string statement(int depth)
+    {
+        string e = expression(pick(0, 3));
+        double k = real();
+        if (depth <= 0 || k < 0.3) {
+            static const vector<string> simple = {"x = @;", "a[@] = 1;", "return @;", "f(@, 1);",
+                                                  "printf(\"v %d\\n\", @);", "g(@);"};
+            string s = one(simple);
+            return s.replace(s.find('@'), 1, e);
+        }
+        if (k < 0.45) {
+            return "if (" + e + ") " + statement(depth - 1);
+        }
+        if (k < 0.6) {
+            string then = statement(depth - 1);
+            return "if (" + e + ") " + then + " else " + statement(depth - 1);
+        }
+        if (k < 0.7) {
+            return "while (" + e + ") " + statement(depth - 1);
+        }
+        if (k < 0.8) {
+            return "for (x = 0; " + e + "; x = x + 1) " + statement(depth - 1);
+        }
+        string out = "{ ";
+        if (chance(0.3)) {
+            out += declaration() + " ";
+        }
+        for (int n = pick(0, 3); n > 0; n--) {
+            out += statement(depth - 1) + " ";
+        }
+        return out + "}";
+    }
+
+    string routine()
+    {
+        static const vector<string> heads = {"function int f", "function char h", "procedure main", "procedure p",
+                                             "function bool g"};
+        static const vector<string> arrays = {"[]", "[5]", "[x]"};
+        static const vector<string> params = {"p", "q", "x", "s"};
+        string out = one(heads) + " (";
+        if (chance(0.3)) {
+            out += "void";
+        } else {
+            for (int k = pick(1, 3); k > 0; k--) {
+                out += one(types()) + " " + one(params) + (chance(0.3) ? one(arrays) : "") + (k > 1 ? ", " : "");
+            }
+        }
+        out += ")\n{\n";
+        for (int k = pick(0, 2); k > 0; k--) {
+            out += "  " + declaration() + "\n";
+        }
+        for (int k = pick(0, 4); k > 0; k--) {
+            out += "  " + statement(pick(0, 4)) + "\n";
+        }
+        return out + "}";
+    }
+
+    // Replaces one space-separated word with a token out of place
+    void damage(string& out)
+    {
+        static const vector<string> stray = {"", ")", "(", "+", ";", "[", "{", "}", "else", ",", "int"};
+        size_t at = static_cast<size_t>(pick(0, static_cast<int>(out.size()) - 1));
+        size_t begin = out.rfind(' ', at);
+        begin = begin == string::npos ? 0 : begin + 1;
+        size_t end = out.find(' ', at);
+        end = end == string::npos ? out.size() : end;
+        out.replace(begin, end - begin, one(stray));
+    }
+
+    static const vector<string>& types()
+    {
+        static const vector<string> all = {"int", "char", "bool"};
+        return all;
+    }
+};
+
+#endif
@@ -0,0 +1,67 @@
+// Times CSTParser::reparse() against parsing from scratch, for one-byte edits
+// spread over a large generated program (or a file). Each edit is typed and
+// then undone, so the program stays valid.
+//
+// usage: ReparseBench [file] [edits]
+
+#include "CSTParser.h"
+#include "ProgramGenerator.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    string text;
+    if (argc > 1) {
+        ifstream in(argv[1], ios::binary);
+        ostringstream read;
+        read << in.rdbuf();
+        text = read.str();
+    } else {
+        ProgramGenerator gen(1);
+        while (text.size() < (4u << 20)) {
+            text += gen.cleanProgram(12);
+        }
+    }
+    int edits = argc > 2 ? atoi(argv[2]) : 200;
+
+    auto start = chrono::steady_clock::now();
+    ParseResult full;
+    CSTParser(text).parse(full);
+    double parseTime = secondsSince(start);
+
+    // Edits go just inside units spread over the text: a space after a ';'
+    IncrementalTokenizer source(text);
+    ParseResult tree;
+    CSTParser(source.text()).parse(tree);
+    start = chrono::steady_clock::now();
+    size_t at = 0;
+    for (int e = 0; e < edits; e++) {
+        at = text.find(';', (at + text.size() / edits) % text.size());
+        if (at == string::npos) {
+            at = text.find(';');
+        }
+        CSTParser::reparse(source, tree, at + 1, 0, " ");
+        CSTParser::reparse(source, tree, at + 1, 1, "");
+    }
+    double reparseTime = secondsSince(start) / (2 * edits);
+
+    cout << text.size() << " bytes, " << full.size() << " nodes" << endl;
+    cout << "parse:   " << parseTime * 1e3 << " ms" << endl;
+    cout << "reparse: " << reparseTime * 1e3 << " ms per edit" << endl;
+    return 0;
+}
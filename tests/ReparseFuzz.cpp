@@ -0,0 +1,88 @@
+// Edits random programs at random places and checks that CSTParser::reparse()
+// leaves the tree parsing the edited text from scratch makes, or reports the
+// error that parsing it reports. Errors exit the process, so each parse whose
+// outcome is not known yet runs in a child process of its own.
+//
+// usage: ReparseFuzz [programs] [edits per program] [first seed]
+
+#include "EquivalenceTest.h"
+#include "ProgramGenerator.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// Text typed in: whole units and statements, and the pieces that open,
+// close or break them
+const vector<string> snippets = {"x", ";", "}", "{", " ", "\n", "int q;", "/*", "*/", "\"", "'", "(", ")",
+                                 "function int h(int a) { return a; }\n", "procedure p(void) { x = 1; }\n",
+                                 "if (x) y = 2;", "while (a < b) { b = b - 1; }", "bool", "0", "// c\n",
+                                 "char s[4];\n", "return 1;", "else"};
+
+}
+
+int main(int argc, char* argv[])
+{
+    int programs = argc > 1 ? atoi(argv[1]) : 50;
+    int edits = argc > 2 ? atoi(argv[2]) : 60;
+    unsigned seed = argc > 3 ? static_cast<unsigned>(atoi(argv[3])) : 1;
+
+    int failed = 0;
+    int reparsed = 0;
+    int rejected = 0;
+    for (int p = 0; p < programs; p++, seed++) {
+        ProgramGenerator gen(seed);
+        string text;
+        while (text.empty() || isolated([&]() { CSTParser(text).parse(); return string(); }).status != 0) {
+            text = gen.program(12);
+        }
+        IncrementalTokenizer source(text);
+        ParseResult tree;
+        CSTParser(source.text()).parse(tree);
+
+        for (int e = 0; e < edits; e++) {
+            size_t offset = static_cast<size_t>(gen.pick(0, static_cast<int>(text.size())));
+            size_t length = gen.chance(0.25) ? 0 : min<size_t>(text.size() - offset, gen.pick(0, 12));
+            string replacement;
+            double k = gen.real();
+            if (k < 0.25) {
+                replacement = gen.one(snippets);
+            } else if (k < 0.5) {
+                size_t from = static_cast<size_t>(gen.pick(0, static_cast<int>(text.size())));
+                replacement = text.substr(from, gen.pick(0, 30));
+            } else if (k < 0.75) {
+                replacement = text.substr(offset, length);
+            }
+            string edited = text.substr(0, offset) + replacement + text.substr(offset + length);
+
+            Outcome full = isolated([&]() {
+                ParseResult fresh;
+                return dump(CSTParser(edited).parse(fresh));
+            });
+            Outcome incremental;
+            if (full.status == 0) {
+                // Only edits that leave a valid program are kept
+                incremental = Outcome{0, dump(CSTParser::reparse(source, tree, offset, length, replacement))};
+                text = edited;
+                reparsed++;
+            } else {
+                incremental = isolated([&]() {
+                    return dump(CSTParser::reparse(source, tree, offset, length, replacement));
+                });
+                rejected++;
+            }
+            if (incremental != full) {
+                cout << "FAIL: seed " << seed << ", edit " << e << ": " << offset << " +" << length << " \""
+                     << replacement << "\"" << endl;
+                failed++;
+                break;
+            }
+        }
+    }
+
+    cout << programs - failed << " of " << programs << " edited programs reparsed as from scratch ("
+         << reparsed << " edits kept, " << rejected << " rejected)" << endl;
+    return failed == 0 ? 0 : 1;
+}
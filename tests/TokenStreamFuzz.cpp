@@ -0,0 +1,122 @@
+// Parses random programs from the source, through the TokenStream that lexes
+// a batch at a time, and from tokens lexed up front into a vector and into a
+// TokenStore, and unit by unit with parseUnit(), also from a SourceBuffer
+// reading it from a pipe that it is written to a few bytes at a time; and
+// checks that every way gives the same tree or reports the same error. A
+// program with a lexical
+// error may report a syntax error ahead of it when streamed, so there only
+// the streamed parses are compared, and they must fail.
+//
+// usage: TokenStreamFuzz [programs] [first seed]
+
+#include "EquivalenceTest.h"
+#include "ProgramGenerator.h"
+#include "SourceBuffer.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// What a program's text may be broken with: lexical errors, and pieces that
+// lex but end a batch somewhere new or hold a line break a read may end on
+const vector<string> breaks = {"\"", "/*", "'ab'", "@", "'", "99999999999", "\"\\q\"", "0x", "/", "*/",
+                               "x1", "// c\n", "'\\n'", "/* a\n\n b */", "\n/*\n*/\n"};
+
+// The tree parseUnit() makes, a unit at a time, dumped as the units of the
+// tree parse() makes are
+string dumpUnits(CSTParser& parser)
+{
+    ParseResult unit;
+    string out;
+    while (TreeRef node = parser.parseUnit(unit)) {
+        out += dump(node);
+    }
+    return out;
+}
+
+// dumpUnits() of text read from standard input, as main reads "-", while a
+// child writes it there in pieces of up to most bytes, pausing after each
+string dumpPiped(const string& text, ProgramGenerator& gen, int most)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(2);
+    }
+    if (fork() == 0) {
+        close(fds[0]);
+        for (size_t at = 0; at < text.size();) {
+            size_t piece = min(text.size() - at, static_cast<size_t>(gen.pick(1, most)));
+            if (write(fds[1], text.data() + at, piece) < 0) {
+                _exit(0);
+            }
+            at += piece;
+            usleep(20);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+
+    SourceBuffer source;
+    source.open("-");
+    CSTParser parser(source);
+    return dumpUnits(parser);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int programs = argc > 1 ? atoi(argv[1]) : 300;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+
+    int failed = 0;
+    int lexed = 0;
+    for (int p = 0; p < programs; p++, seed++) {
+        ProgramGenerator gen(seed);
+        string text = gen.program(12);
+        for (int k = gen.chance(0.5) ? gen.pick(1, 2) : 0; k > 0; k--) {
+            text.insert(static_cast<size_t>(gen.pick(0, static_cast<int>(text.size()))), gen.one(breaks));
+        }
+
+        Outcome streamed = isolated([&]() { return dump(CSTParser(text).parse()->leftChild); });
+        Outcome units = isolated([&]() {
+            CSTParser parser(text);
+            return dumpUnits(parser);
+        });
+        int most = gen.chance(0.5) ? 16 : 512;
+        Outcome piped = isolated([&]() { return dumpPiped(text, gen, most); });
+        bool same = units == streamed && piped == streamed;
+
+        Outcome lexing = isolated([&]() {
+            Tokenizer::tokenize(text);
+            return string();
+        });
+        if (lexing.status == 0) {
+            lexed++;
+            Outcome vectored = isolated([&]() {
+                vector<Token> tokens = Tokenizer::tokenize(text);
+                return dump(CSTParser(tokens, text).parse()->leftChild);
+            });
+            Outcome stored = isolated([&]() {
+                TokenStore store = Tokenizer::tokenizeStore(text);
+                return dump(CSTParser(store, text).parse()->leftChild);
+            });
+            same = same && vectored == streamed && stored == streamed;
+        } else {
+            same = same && streamed.status == 1;
+        }
+        if (!same) {
+            cout << "FAIL: seed " << seed << endl;
+            failed++;
+        }
+    }
+
+    cout << programs - failed << " of " << programs << " programs parsed alike streamed and lexed up front ("
+         << lexed << " without a lexical error)" << endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#!/bin/sh
+# Runs the driver over every input in tests/regress and compares what it
+# prints with the .expected file next to the input: standard output, then
+# "--- stderr" and standard error, then "--- exit" and the exit status.
+# Inputs too large to check in are generated below, with their expected
+# output written alongside.
+#
+# usage: run_regress.sh [path to main] [--update]
+# --update rewrites the .expected files from the current driver instead.
+
+MAIN=${1:-./main}
+UPDATE=$2
+DIR=$(dirname "$0")/regress
+TMP=${TMPDIR:-/tmp}/regress.$$
+trap 'rm -f "$TMP".*' EXIT
+
+# Prints what the driver does with input $1, laid out as a .expected file
+run() {
+    "$MAIN" "$1" > "$TMP.out" 2> "$TMP.err"
+    rc=$?
+    cat "$TMP.out"
+    echo "--- stderr"
+    cat "$TMP.err"
+    echo "--- exit $rc"
+}
+
+failed=0
+count=0
+
+# Compares the driver's output for input $2 with expected file $3, naming
+# the case $1
+check() {
+    count=$((count + 1))
+    if ! run "$2" | cmp -s - "$3"; then
+        echo "FAIL: $1"
+        run "$2" | diff "$3" - | head -10
+        failed=$((failed + 1))
+    fi
+}
+
+for input in "$DIR"/*.txt; do
+    expected=${input%.txt}.expected
+    if [ "$UPDATE" = --update ]; then
+        run "$input" > "$expected"
+    else
+        check "$(basename "$input")" "$input" "$expected"
+    fi
+done
+[ "$UPDATE" = --update ] && exit 0
+
+# Offsets are 32 bits, so a 4 GB source is refused before it is read (the
+# file is sparse and takes no disk space)
+if truncate -s 4G "$TMP.huge" 2> /dev/null; then
+    printf '%s\n' "--- stderr" "ERROR: $TMP.huge is larger than 4294967294 bytes" "--- exit 1" > "$TMP.expected"
+    check "4 GB source" "$TMP.huge" "$TMP.expected"
+fi
+
+# Nesting far deeper than native-stack recursion allows: the parser, the AST
+# builder, its printer and the symbol table all keep nesting on the heap.
+# deep NAME N INPUT AST: awk programs (run with n=N) print the input and the
+# AST lines the driver is expected to print for it
+deep() {
+    awk -v n="$2" "BEGIN { $3 }" > "$TMP.deep"
+    {
+        printf '\n%s\n%s\n%s\n' "====================================" \
+            "BUILDING ABSTRACT SYNTAX TREE (AST)" "===================================="
+        awk -v n="$2" "BEGIN { $4 }"
+        printf '\n%s\n%s\n' "--- stderr" "--- exit 0"
+    } > "$TMP.deep.expected"
+    check "$1" "$TMP.deep" "$TMP.deep.expected"
+}
+
+deep "200000 nested !" 200000 \
+    'printf "function int f (void) { return "; for (i = 0; i < n; i++) printf "!"; print "x; }"' \
+    'printf "DECLARATION\nBEGIN BLOCK\nRETURN   x"; for (i = 0; i < n; i++) printf "   !"; print "\nEND BLOCK"'
+deep "100000 nested (" 100000 \
+    'printf "function int f (void) { return "; for (i = 0; i < n; i++) printf "("; printf "x"; for (i = 0; i < n; i++) printf ")"; print "; }"' \
+    'print "DECLARATION\nBEGIN BLOCK\nRETURN   x\nEND BLOCK"'
+deep "100000 nested if" 100000 \
+    'printf "procedure p (void) { int x; "; for (i = 0; i < n; i++) printf "if (x) "; print "x = 1; }"' \
+    'print "DECLARATION\nBEGIN BLOCK\nDECLARATION"; for (i = 0; i < n; i++) print "IF   x"; print "ASSIGNMENT   x   1   =\nEND BLOCK"'
+deep "100000 nested blocks" 100000 \
+    'printf "procedure p (void) { int x; "; for (i = 0; i < n; i++) printf "{ "; printf "x = 1;"; for (i = 0; i < n; i++) printf " }"; print " }"' \
+    'print "DECLARATION\nBEGIN BLOCK\nDECLARATION"; for (i = 0; i < n; i++) print "BEGIN BLOCK"; print "ASSIGNMENT   x   1   ="; for (i = 0; i <= n; i++) print "END BLOCK"'
+# Long operator chains nest as deep, down their left operands
+deep "200000-term + chain" 200000 \
+    'printf "function int f (void) { return x"; for (i = 1; i < n; i++) printf " + x"; print "; }"' \
+    'printf "DECLARATION\nBEGIN BLOCK\nRETURN   x"; for (i = 1; i < n; i++) printf "   x   +"; print "\nEND BLOCK"'
+deep "100000-term * and - chain" 100000 \
+    'printf "function int f (void) { return x * x"; for (i = 1; i < n; i++) printf " - x * x"; print "; }"' \
+    'printf "DECLARATION\nBEGIN BLOCK\nRETURN   x   x   *"; for (i = 1; i < n; i++) printf "   x   x   *   -"; print "\nEND BLOCK"'
+
+echo "$((count - failed)) of $count regression inputs passed"
+[ "$failed" -eq 0 ]